@@ -3,6 +3,7 @@
 #
 
 option(${PROJECT_NAME}_BUILD_EXECUTABLE "Build the project as an executable, rather than a library." ON)
+option(${PROJECT_NAME}_BUILD_SIMULATOR "Build rema_sim, a local stand-in for the REMA controller (see sim/)." OFF)
 option(${PROJECT_NAME}_USE_ALT_NAMES "Use alternative names for the project, such as naming the include directory all lowercase." OFF)
 
 #
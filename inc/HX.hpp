@@ -5,6 +5,7 @@
 #include <set>
 #include <vector>
 
+#include "cached_content.hpp"
 #include "csv.hpp"
 #include "nlohmann/json.hpp"
 #include "points.hpp"
@@ -33,6 +34,7 @@ class HX {
 
     std::string hx;
     std::string tubesheet_svg;
+    SharedContent tubesheet_svg_content; // Hashed and compressed for /HXs_svg, served while a session loads
     float tube_od;
     std::string leg = "both";
     std::string unit = "inch";
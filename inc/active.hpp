@@ -1,5 +1,6 @@
 #pragma once
 
+#include <condition_variable>
 #include <deque>
 #include <functional>
 #include <mutex>
@@ -14,8 +15,9 @@ class Active {
     void run(std::stop_token stop_token) {
         while (!stop_token.stop_requested()) { 
             std::unique_lock<std::mutex> lock(mtx);
-            cv.wait(lock, [this] { return !mq.empty(); });      // During the wait the mutex is unlocked
-                                                                // The mutex is automatically re-acquired here
+            if (!cv.wait(lock, stop_token, [this] { return !mq.empty(); })) { // During the wait the mutex is unlocked
+                return;                                                     // Woken by the stop request on destruction
+            }                                                               // The mutex is automatically re-acquired here
             Message msg = mq.front();                           
             mq.pop_front();
             lock.unlock();
@@ -25,7 +27,7 @@ class Active {
 
   public:
     Active() {
-        thd = std::jthread(&Active::run, this);
+        thd = std::jthread([this](std::stop_token stop_token) { run(stop_token); });
     }
 
     void send(Message m) {
@@ -39,7 +41,7 @@ class Active {
     Active(const Active &) = delete;         // no copying
     void operator=(const Active &) = delete; // no copying
     std::deque<Message> mq;                  // the queue
-    std::jthread thd;                        // the thread
     std::mutex mtx;                          // to make deque thread_safe
-    std::condition_variable cv;
+    std::condition_variable_any cv;
+    std::jthread thd;                        // the thread, last so that it is stopped and joined before the rest goes
 };
\ No newline at end of file
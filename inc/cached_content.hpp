@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+// A response body kept in memory with its content hash and copies compressed ahead of time
+struct CachedContent {
+    std::string content_type;
+    std::string hash;   // Hex, the ETag without the encoding suffix
+    std::string identity;
+    std::string gzip;   // Empty when compressing doesn't make it smaller
+    std::string brotli;
+
+    static std::shared_ptr<const CachedContent> make(std::string body, std::string content_type);
+};
+
+// A CachedContent that one thread replaces while others serve it. Copies take a snapshot, so that whatever holds it
+// stays copyable
+class SharedContent {
+  public:
+    SharedContent() = default;
+
+    SharedContent(const SharedContent &other) : ptr(other.load()) {
+    }
+
+    SharedContent &operator=(const SharedContent &other) {
+        store(other.load());
+        return *this;
+    }
+
+    std::shared_ptr<const CachedContent> load() const {
+        std::lock_guard lock(mtx);
+        return ptr;
+    }
+
+    void store(std::shared_ptr<const CachedContent> content) {
+        std::lock_guard lock(mtx);
+        ptr.swap(content); // The old one, if this was its last owner, is freed after unlocking
+    }
+
+  private:
+    mutable std::mutex mtx;
+    std::shared_ptr<const CachedContent> ptr;
+};
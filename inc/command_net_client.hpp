@@ -1,18 +1,284 @@
 #pragma once
 
+#include "metrics.hpp"
+#include "msgpack_frame.hpp"
+#include "msgpack_writer.hpp"
 #include "net_client.hpp"
+#include "traffic_recorder.hpp"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <mutex>
 #include <restbed>
+#include <set>
 #include <spdlog/spdlog.h>
 #include <string>
 #include <thread>
 
+// Command channel with several requests in flight.
+// Every request gets a promise queued in send order. A reply carrying a "request_id" completes the matching request and
+// is dropped if there is none. An untagged reply completes the oldest one, which is what the RTU answers first as it
+// handles commands in order.
+// The channel starts every connection as JSON (requests as is, replies null terminated) and switches to msgpack both
+// ways if negotiate_encoding() finds that the RTU firmware supports it.
 class CommandNetClient : public NetClient {
   public:
+    enum class Encoding { JSON, MSGPACK };
+
     CommandNetClient() {
     }
 
     ~CommandNetClient() {
     }
+
+    uint64_t next_request_id() {
+        return ++last_request_id;
+    }
+
+    // Label for the command metrics: the name if the RTU firmware knows the command, else "other". The UI's command
+    // names come from the request body, and every label is a series that lives as long as the proxy
+    static const std::string &metric_label(const std::string &name) {
+        static const std::set<std::string> known = { "AXES_HARD_STOP_ALL", "AXES_SETTINGS",          "AXES_SOFT_STOP_ALL",
+                                                      "BRAKES_MODE",        "CONTROL_ENABLE",         "LOG_LEVEL",
+                                                      "MEM_INFO",           "MOVE_CLOSED_LOOP",       "MOVE_INCREMENTAL",
+                                                      "MOVE_JOYSTICK",      "NETWORK_SETTINGS",       "PROTOCOL",
+                                                      "SET_COORDS",         "STALL_CONTROL_SETTINGS", "TOUCH_PROBE",
+                                                      "TOUCH_PROBE_SETTINGS" };
+        static const std::string other = "other";
+        auto iter = known.find(name);
+        return iter != known.end() ? *iter : other;
+    }
+
+    Encoding encoding() const {
+        return encoding_;
+    }
+
+    // Offers msgpack to the RTU. Call it right after connecting, before any other command. Firmware that doesn't know
+    // the PROTOCOL command answers with an error and the channel stays JSON.
+    // Without an answer within timeout the connection is dropped, as a late answer would be taken for the reply to
+    // the next command, and the following connection stays JSON without asking. Returns false in that case
+    bool negotiate_encoding(std::chrono::milliseconds timeout = std::chrono::seconds(2)) {
+        std::lock_guard<std::mutex> send_lock(send_mtx); // nothing else goes out until both ends agree
+        if (skip_negotiation.exchange(false)) {
+            SPDLOG_INFO("RTU didn't answer PROTOCOL last time, keeping JSON commands");
+            return true;
+        }
+
+        uint64_t request_id = next_request_id();
+        tx_buffer.clear();
+        append_json_envelope("PROTOCOL", { { "encoding", "msgpack" } }, request_id);
+
+        uint64_t seq;
+        auto reply = send(tx_buffer, request_id, "PROTOCOL", true, seq);
+        if (reply.wait_for(timeout) != std::future_status::ready) {
+            SPDLOG_WARN("No answer to PROTOCOL, reconnecting with JSON commands");
+            // The request stays in flight until the teardown, so a reply arriving meanwhile still lands on it
+            skip_negotiation = true;
+            close();
+            return false;
+        }
+
+        try {
+            nlohmann::json res = parse_reply(reply.get());
+            if (res["PROTOCOL"].value("encoding", "") == "msgpack") {
+                encoding_ = Encoding::MSGPACK;
+                SPDLOG_INFO("Using msgpack commands");
+                return true;
+            }
+        } catch (std::exception &e) {
+            SPDLOG_WARN("Unexpected answer to PROTOCOL: {}", e.what());
+        }
+        SPDLOG_INFO("RTU firmware doesn't support msgpack, keeping JSON commands");
+        return true;
+    }
+
+    // Sends a single command. The request is written into a buffer reused across commands, in the negotiated encoding.
+    // The future holds an empty string if the request could not be sent or the connection dropped before the reply
+    std::future<std::string> command(const std::string &cmd, const nlohmann::json &pars, uint64_t request_id) {
+        std::lock_guard<std::mutex> send_lock(send_mtx);
+        tx_buffer.clear();
+        if (encoding_ == Encoding::MSGPACK) {
+            msgpack_writer::array_header(tx_buffer, 1);
+            msgpack_writer::map_header(tx_buffer, pars.is_null() ? 2 : 3);
+            msgpack_writer::str(tx_buffer, "cmd");
+            msgpack_writer::str(tx_buffer, cmd);
+            msgpack_writer::str(tx_buffer, "request_id");
+            msgpack_writer::uint(tx_buffer, request_id);
+            if (!pars.is_null()) {
+                msgpack_writer::str(tx_buffer, "pars");
+                nlohmann::json::to_msgpack(pars, tx_buffer);
+            }
+        } else {
+            append_json_envelope(cmd, pars, request_id);
+        }
+        uint64_t seq;
+        return send(tx_buffer, request_id, cmd, true, seq);
+    }
+
+    // Sends an already serialized JSON request, re-encoded if the channel is msgpack. tagged tells whether the payload
+    // itself carries request_id, an untagged payload with a request_id of its own is matched by that one. name is what
+    // its round trip time is accounted under
+    std::future<std::string>
+    request(const std::string &payload, uint64_t request_id, const std::string &name, bool tagged = true) {
+        std::lock_guard<std::mutex> send_lock(send_mtx);
+        if (uint64_t own_id = reply_id(payload); !tagged && own_id) {
+            // Its reply echoes that id, and a reply with an id nobody waits for is dropped
+            request_id = own_id;
+            tagged = true;
+        }
+        uint64_t seq;
+        if (encoding_ == Encoding::MSGPACK) {
+            tx_buffer.clear();
+            nlohmann::json::to_msgpack(nlohmann::json::parse(payload), tx_buffer);
+            return send(tx_buffer, request_id, name, tagged, seq);
+        }
+        return send(payload, request_id, name, tagged, seq);
+    }
+
+    // Decodes a reply, whichever encoding it came in
+    static nlohmann::json parse_reply(const std::string &reply) {
+        if (!reply.empty() && msgpack_frame::is_map(static_cast<uint8_t>(reply[0]))) {
+            return nlohmann::json::from_msgpack(reply);
+        }
+        return nlohmann::json::parse(reply);
+    }
+
+  protected:
+    void on_connected() override {
+        encoding_ = Encoding::JSON; // the RTU may have restarted with other firmware
+    }
+
+    void on_data() override {
+        std::lock_guard<std::mutex> lock(mtx);
+        while (true) {
+            std::string_view frame;
+            uint64_t id = 0;
+            if (encoding_ == Encoding::MSGPACK) {
+                std::string_view pending = rx_buffer_.data();
+                auto bytes = reinterpret_cast<const uint8_t *>(pending.data());
+                std::size_t size = msgpack_frame::object_size(bytes, pending.size());
+                if (size == msgpack_frame::invalid) {
+                    SPDLOG_ERROR("Command stream out of sync, dropping {} bytes", pending.size());
+                    rx_buffer_.clear();
+                    return;
+                }
+                if (size == msgpack_frame::incomplete) {
+                    return;
+                }
+                rx_buffer_.consume(size);
+                frame = pending.substr(0, size);
+                id = msgpack_frame::find_uint(bytes, size, "request_id");
+            } else if (auto next = rx_buffer_.next_frame('\0')) {
+                frame = *next;
+                id = reply_id(frame);
+            } else {
+                return;
+            }
+
+            if (in_flight.empty()) {
+                SPDLOG_WARN("Unsolicited reply from REMA ({} bytes)", frame.size());
+                continue;
+            }
+
+            auto pending = in_flight.begin();
+            if (id) {
+                pending = std::find_if(in_flight.begin(), in_flight.end(),
+                                       [id](const PendingRequest &p) { return p.tagged && p.request_id == id; });
+                if (pending == in_flight.end()) {
+                    // A late reply to a request that was already given up on, it must not complete another one
+                    SPDLOG_WARN("Unsolicited reply from REMA to request_id {}", id);
+                    continue;
+                }
+            }
+            traffic_recorder.record(traffic::Record::REPLY, frame);
+            pending->rtt->record(std::chrono::steady_clock::now() - pending->sent_at);
+            pending->reply.set_value(std::string(frame));
+            in_flight.erase(pending);
+        }
+    }
+
+    void on_disconnected() override {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto &pending : in_flight) {
+            pending.reply.set_value({});
+        }
+        in_flight.clear();
+    }
+
+  private:
+    struct PendingRequest {
+        uint64_t seq;
+        uint64_t request_id;
+        bool tagged;
+        LatencyHistogram *rtt;
+        std::chrono::steady_clock::time_point sent_at;
+        std::promise<std::string> reply;
+    };
+
+    // send_mtx must be held, in_flight order must match the order on the wire
+    std::future<std::string>
+    send(const std::string &payload, uint64_t request_id, const std::string &name, bool tagged, uint64_t &seq) {
+        std::future<std::string> reply;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            seq = ++last_seq;
+            in_flight.push_back({ seq, request_id, tagged, &metrics.command_rtt[metric_label(name)], std::chrono::steady_clock::now(), {} });
+            reply = in_flight.back().reply.get_future();
+        }
+
+        traffic_recorder.record(traffic::Record::COMMAND, payload);
+        if (!send_request(payload)) {
+            fail(seq);
+        }
+        return reply;
+    }
+
+    // Gives up on a request, unless a disconnection or its reply already completed it
+    void fail(uint64_t seq) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto it = in_flight.begin(); it != in_flight.end(); ++it) {
+            if (it->seq == seq) {
+                it->reply.set_value({});
+                in_flight.erase(it);
+                break;
+            }
+        }
+    }
+
+    void append_json_envelope(const std::string &cmd, const nlohmann::json &pars, uint64_t request_id) {
+        tx_buffer.append("[{\"cmd\":").append(nlohmann::json(cmd).dump());
+        tx_buffer.append(",\"request_id\":").append(std::to_string(request_id));
+        if (!pars.is_null()) {
+            tx_buffer.append(",\"pars\":").append(pars.dump());
+        }
+        tx_buffer.append("}]");
+    }
+
+    // Finds "request_id":<n> in a reply, or a request, without parsing it, 0 if there is none
+    static uint64_t reply_id(std::string_view frame) {
+        constexpr std::string_view key = "\"request_id\":";
+        if (auto pos = frame.find(key); pos != std::string_view::npos) {
+            pos += key.size();
+            uint64_t id = 0;
+            while (pos < frame.size() && frame[pos] >= '0' && frame[pos] <= '9') {
+                id = id * 10 + (frame[pos++] - '0');
+            }
+            return id;
+        }
+        return 0;
+    }
+
+    std::mutex send_mtx;
+    std::mutex mtx;
+    std::deque<PendingRequest> in_flight;
+    std::string tx_buffer; // guarded by send_mtx, keeps its capacity from one request to the next
+    uint64_t last_seq = 0;
+    std::atomic<uint64_t> last_request_id = 0;
+    std::atomic<Encoding> encoding_ = Encoding::JSON;
+    std::atomic<bool> skip_negotiation = false; // the last PROTOCOL went unanswered
 };
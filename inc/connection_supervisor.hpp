@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "active.hpp"
+#include "net_client.hpp"
+#include "nlohmann/json.hpp"
+#include "reactor.hpp"
+
+enum class LinkState { DISCONNECTED, BACKOFF, CONNECTING, CONNECTED };
+
+// Keeps every RTU channel connected.
+// A channel that fails to connect, or loses an established connection, is retried after a jittered exponential
+// backoff. All the bookkeeping runs on the reactor thread, so nothing here ever blocks an HTTP worker.
+class ConnectionSupervisor {
+  public:
+    explicit ConnectionSupervisor(Reactor &reactor);
+
+    // on_up runs on a worker thread after every successful connection and may block (e.g. sending commands)
+    void add_channel(
+        const std::string &name,
+        NetClient &client,
+        int port_offset,
+        bool required,
+        std::function<void()> on_up = {});
+
+    // Thread safe. Drops whatever is connected and connects every channel to the new endpoint right away
+    void connect(const std::string &host, int base_port);
+
+    // Least healthy state among the required channels
+    LinkState state() const;
+
+    nlohmann::json status() const;
+
+    // Bumped on every state change, lets pollers tell whether status() is worth sending
+    uint64_t version() const {
+        return state_version;
+    }
+
+    // Reactor thread: called after every state change, must not block
+    void set_on_change(std::function<void()> callback) {
+        on_change = callback;
+    }
+
+    std::chrono::milliseconds backoff_base = std::chrono::milliseconds(250);
+    std::chrono::milliseconds backoff_max = std::chrono::seconds(30);
+    std::chrono::milliseconds connect_timeout = std::chrono::seconds(5);
+
+  private:
+    struct Channel {
+        std::string name;
+        NetClient *client;
+        int port_offset;
+        bool required;
+        std::function<void()> on_up;
+        std::atomic<LinkState> state = LinkState::DISCONNECTED;
+        int attempt = 0;
+        uint64_t generation = 0; // invalidates callbacks and timers of superseded attempts
+    };
+
+    void try_connect(Channel &channel);
+
+    void schedule_retry(Channel &channel);
+
+    void set_state(Channel &channel, LinkState state);
+
+    Reactor &reactor;
+    std::string host;
+    int base_port = 0;
+    std::vector<std::unique_ptr<Channel>> channels;
+    std::atomic<uint64_t> state_version = 0;
+    std::function<void()> on_change;
+    std::minstd_rand rng{ std::random_device{}() };
+    Active worker;
+};
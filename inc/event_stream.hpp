@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <restbed>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "rema.hpp" // Before event_stream, so that rema outlives the broadcaster thread
+#include "telemetry.hpp"
+
+// How often a Server Sent Events client gets telemetry, chosen by the client in the /sse query string.
+// Telemetry is sent when something other than the coordinates changed or the coordinates moved at least min_delta,
+// at most fps times per second, and at least every max_interval to show that the stream is alive
+struct TelemetryPolicy {
+    double fps = 10;                                  // ?fps=
+    double min_delta = 0.0001;                        // ?min_delta= UI units, on any axis
+    bool extrapolate = false;                         // ?extrapolate=1 coords projected to the send time
+    std::chrono::milliseconds max_interval{ 1000 };   // ?max_interval_ms=
+
+    static TelemetryPolicy from_request(const restbed::Request &request);
+};
+
+// The /sse endpoint, fed by an event bus.
+// Clients subscribe to topics with /sse?topics=telemetry,temps,connection,session,logs,plan, all but logs and plan
+// by default. Each topic goes out as its own message, serialized once and shared by every subscriber.
+// Producers publish() the topics that changed, from any thread, and the broadcaster thread sends them right away,
+// coalescing whatever else is published within coalescing_window. It also wakes when a client's telemetry policy has
+// a frame due later, a rate limited change, an extrapolated frame or a keep-alive, and sleeps otherwise.
+// A client has a single write in flight; meanwhile its telemetry is replaced by the latest and other events wait in a
+// bounded queue. A client whose queue overflows or whose write doesn't complete within stall_timeout is disconnected,
+// so it never holds up the others.
+// Every logs message carries, as its SSE id, the number of the RTU log line after it. A logs client that gives the
+// number it needs next, with ?logs_from= or through the Last-Event-ID its browser sends on reconnect, first gets the
+// kept lines it missed
+class EventStream {
+  public:
+    enum Topic : uint32_t {
+        TELEMETRY = 1 << 0,
+        TEMPS = 1 << 1,
+        CONNECTION = 1 << 2,
+        SESSION = 1 << 3,
+        LOGS = 1 << 4,
+        PLAN = 1 << 5,
+    };
+
+    static constexpr uint32_t default_topics = TELEMETRY | TEMPS | CONNECTION | SESSION;
+
+    // ?topics=, default_topics if missing
+    static uint32_t topics_from_request(const restbed::Request &request);
+
+    // Last-Event-ID, else ?logs_from=, nothing if neither is there
+    static std::optional<uint64_t> logs_from_request(const restbed::Request &request);
+
+    static constexpr std::chrono::milliseconds min_frame_interval{ 20 }; // Highest telemetry rate a client can get
+    static constexpr std::chrono::milliseconds coalescing_window{ 5 };
+    static constexpr std::chrono::seconds stall_timeout{ 5 };
+    static constexpr std::size_t max_queued_events = 64;
+
+    // Any thread, never blocks for long
+    void publish(Topic topic) {
+        if (pending.fetch_or(topic, std::memory_order_release) == 0) {
+            {
+                // Empty critical section: the broadcaster is either before its predicate check or already waiting
+                std::lock_guard<std::mutex> lock(wake_mtx);
+            }
+            wake.notify_one();
+        }
+    }
+
+    // Any thread, tube changes since the last broadcast go out together
+    void publish_tube_executed(const std::string &plan, const std::string &tube_id, bool executed);
+
+    void add_client(const std::shared_ptr<restbed::Session> &session, const TelemetryPolicy &policy, uint32_t topics,
+                    std::optional<uint64_t> logs_from = std::nullopt);
+
+    // Other transports. Called on the broadcaster thread with the topics of every broadcast, must not block
+    void add_listener(std::function<void(uint32_t topics)> listener);
+
+    void start();
+
+  private:
+    using time_point = std::chrono::steady_clock::time_point;
+    using Message = std::shared_ptr<const std::string>;
+
+    struct Client {
+        std::shared_ptr<restbed::Session> session;
+        TelemetryPolicy policy;
+        uint32_t topics = default_topics;
+        time_point last_sent_at;
+        struct telemetry last_sent;
+        bool last_show_target = false;
+        bool sent_any = false;
+        time_point next_at; // When the broadcaster has to look at this client again without a publish
+        uint64_t logs_next = 0; // Number of the next RTU log line it needs, under mtx
+
+        // Outbound, under mtx
+        std::deque<Message> queued_events;
+        Message queued_telemetry; // Only the latest
+        bool writing = false;
+        time_point writing_since;
+        bool evicted = false;
+    };
+
+    void run(std::stop_token stop);
+
+    void broadcast(uint32_t topics);
+
+    bool telemetry_changed(const Client &client, const struct telemetry &candidate, bool show_target) const;
+
+    // Under mtx. False if the client has to be evicted
+    bool enqueue(Client &client, const Message &message, bool telemetry);
+
+    // Under mtx. The next message for the client, marked in flight, or nullptr
+    Message next_write(Client &client);
+
+    // Without mtx
+    void write(const std::shared_ptr<Client> &client, Message message);
+
+    void evict(Client &client, const char *reason);
+
+    std::atomic<uint32_t> pending = 0;
+    std::mutex wake_mtx;
+    std::condition_variable_any wake;
+
+    std::mutex pending_mtx; // pending_tubes
+    nlohmann::json pending_tubes = nlohmann::json::array();
+
+    std::mutex mtx; // clients
+    std::vector<std::shared_ptr<Client>> clients;
+    std::vector<std::function<void(uint32_t)>> listeners; // Under mtx
+    uint64_t logs_sent = 0; // RTU log lines numbered below it went out to the logs clients, under mtx
+    time_point next_deadline = time_point::max(); // Broadcaster thread only
+    time_point last_published_received_at;        // For the link's receive to publish latency, broadcaster thread only
+    std::jthread broadcaster; // Last, so that it is stopped before anything it uses is destroyed
+};
+
+inline EventStream event_stream;
+
+void event_stream_create_endpoints(restbed::Service &service);
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Receive buffer for delimiter-framed streams.
+// Data is read straight into the free tail of the buffer and frames are handed out as views into it, so no byte is
+// copied twice. Consumed space is reclaimed by sliding the unread bytes back to the front only when the tail runs out,
+// which keeps every frame contiguous. The delimiter search resumes where the previous one stopped, so a reply split
+// across many reads is still scanned once.
+// The buffer grows up to max_size, so a peer that never sends a delimiter can't take all the memory: once the unread
+// bytes fill it, prepare() returns nullptr and the connection has to be dropped.
+class FrameBuffer {
+  public:
+    explicit FrameBuffer(std::size_t capacity = 4096, std::size_t max_size = 1 << 20)
+        : buf_(std::min(capacity, max_size)), max_size_(max_size) {
+    }
+
+    // Returns a pointer to the free tail, compacting or growing the buffer so that it has at least min_free bytes, or
+    // fewer if max_size doesn't allow it. nullptr if the unread bytes already take max_size
+    char *prepare(std::size_t min_free) {
+        if (buf_.size() - tail_ < min_free) {
+            compact();
+            if (buf_.size() - tail_ < min_free) {
+                buf_.resize(std::min(tail_ + min_free, max_size_));
+            }
+        }
+        return tail_ < buf_.size() ? buf_.data() + tail_ : nullptr;
+    }
+
+    std::size_t writable() const {
+        return buf_.size() - tail_;
+    }
+
+    // Marks n bytes written after prepare() as readable
+    void commit(std::size_t n) {
+        tail_ += n;
+    }
+
+    // Returns the next complete frame, without its delimiter. The view is only valid until the next prepare() or clear()
+    std::optional<std::string_view> next_frame(char delim = '\0') {
+        const char *start = buf_.data() + scan_;
+        if (const void *found = std::memchr(start, delim, tail_ - scan_)) {
+            std::size_t end = static_cast<const char *>(found) - buf_.data();
+            std::string_view frame(buf_.data() + head_, end - head_);
+            head_ = scan_ = end + 1;
+            if (head_ == tail_) {
+                head_ = scan_ = tail_ = 0;
+            }
+            return frame;
+        }
+        scan_ = tail_;
+        return std::nullopt;
+    }
+
+    // Unframed access to everything buffered so far
+    std::string_view data() const {
+        return { buf_.data() + head_, tail_ - head_ };
+    }
+
+    void consume(std::size_t n) {
+        head_ += n;
+        if (scan_ < head_) {
+            scan_ = head_;
+        }
+        if (head_ == tail_) {
+            head_ = scan_ = tail_ = 0;
+        }
+    }
+
+    std::size_t size() const {
+        return tail_ - head_;
+    }
+
+    std::size_t max_size() const {
+        return max_size_;
+    }
+
+    bool empty() const {
+        return head_ == tail_;
+    }
+
+    void clear() {
+        head_ = scan_ = tail_ = 0;
+    }
+
+  private:
+    void compact() {
+        if (head_ > 0) {
+            std::memmove(buf_.data(), buf_.data() + head_, tail_ - head_);
+            tail_ -= head_;
+            scan_ -= head_;
+            head_ = 0;
+        }
+    }
+
+    std::vector<char> buf_;
+    const std::size_t max_size_;
+    std::size_t head_ = 0; // first unread byte
+    std::size_t scan_ = 0; // delimiter search resumes here
+    std::size_t tail_ = 0; // one past the last received byte
+};
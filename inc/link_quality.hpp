@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "nlohmann/json.hpp"
+
+// Rolling statistics of the telemetry link over the frames received in the last window, reset on every connection.
+// Receive times are the kernel's when the socket timestamps them, so they don't include the proxy's own wakeup delay.
+// Frames that arrive together share a receive time and count as a single arrival, so a batch shows up as one long
+// interarrival rather than a run of zero ones that would hide it. Interarrival and jitter are between arrivals.
+// A gap is an interarrival above gap_factor times the usual one, an EWMA of the interarrivals that weren't gaps
+class LinkQuality {
+  public:
+    struct Snapshot {
+        uint64_t connection = 0;          // Connections since start, 0 before the first one
+        bool kernel_timestamps = false;
+        std::size_t frames = 0;           // In the window
+        std::size_t arrivals = 0;         // Distinct receive times in the window, fewer than frames if they batch up
+        double fps = 0.;
+        double interarrival_ms = 0.;      // Mean
+        double jitter_ms = 0.;            // Standard deviation of the interarrival
+        uint64_t gaps = 0;                // In the window
+        uint64_t gaps_total = 0;          // This connection
+        double publish_latency_ms = 0.;   // Mean receive to SSE publish
+        double publish_latency_max_ms = 0.;
+    };
+
+    static constexpr double gap_factor = 3.;
+
+    explicit LinkQuality(std::chrono::steady_clock::duration window = std::chrono::seconds(5),
+                         std::size_t max_frames = 1024)
+        : window_(window), max_frames_(max_frames) {
+    }
+
+    // A new connection, starts a fresh window
+    void connected(bool kernel_timestamps);
+
+    // frames received together at received_at
+    void frames_received(std::chrono::steady_clock::time_point received_at, std::size_t frames = 1);
+
+    void frame_published(std::chrono::steady_clock::time_point received_at, std::chrono::steady_clock::time_point published_at);
+
+    Snapshot snapshot(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) const;
+
+  private:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    struct Arrival {
+        time_point at;
+        std::size_t frames;
+    };
+
+    void expire(time_point now) const;
+
+    const std::chrono::steady_clock::duration window_;
+    const std::size_t max_frames_;
+
+    mutable std::mutex mtx;
+    mutable std::deque<Arrival> arrivals;
+    mutable std::deque<time_point> gaps;
+    mutable std::deque<std::pair<time_point, std::chrono::steady_clock::duration>> publish_latencies;
+    double usual_interarrival_s = 0.;
+    uint64_t gaps_total = 0;
+    uint64_t connection = 0;
+    bool kernel_timestamps = false;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(LinkQuality::Snapshot, connection, kernel_timestamps, frames, arrivals, fps,
+                                   interarrival_ms, jitter_ms, gaps, gaps_total, publish_latency_ms, publish_latency_max_ms)
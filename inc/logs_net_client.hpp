@@ -1,14 +1,13 @@
 #pragma once
 
 #include "net_client.hpp"
+#include "traffic_recorder.hpp"
 #include <chrono>
-#include <condition_variable>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <spdlog/spdlog.h>
 #include <string>
-#include <thread>
-#include <watchdog_timer.hpp>
 
 class LogsNetClient : public NetClient {
   public:
@@ -18,34 +17,16 @@ class LogsNetClient : public NetClient {
         onReceiveCb = onReceiveCallback;
     }
 
-    void start() {
-        if (!alreadyStarted) {
-            thd = std::jthread(&LogsNetClient::loop, this);
-            alreadyStarted = true;
-        }
-    }
-
-    int connect(std::string host, int port, int nsec = 0) override {
-        nsec = (nsec == 0 ? ConnectionTimeout : nsec);
-        if (int n; (n = NetClient::connect(host, port, nsec)) < 0) {
-            return n;
-        }
-        return 0;
-    }
+    std::function<void(std::string&)> onReceiveCb;
 
-    void loop(std::stop_token stop_token) {
-        while (!stop_token.stop_requested()) {
-            if (is_connected) {
-                std::string line = get_response();
-                if (!line.empty()) {
-                    onReceiveCb(line);
-                }
+  protected:
+    void on_data() override {
+        while (auto frame = rx_buffer_.next_frame('\0')) {
+            traffic_recorder.record(traffic::Record::LOG, *frame);
+            std::string line(*frame);
+            if (!line.empty() && onReceiveCb) {
+                onReceiveCb(line);
             }
         }
     }
-
-    std::function<void(std::string&)> onReceiveCb;
-    std::jthread thd;
-    bool alreadyStarted = false;
-    int ConnectionTimeout = 5;
 };
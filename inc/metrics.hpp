@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+// HDR style latency histogram.
+// Values are microseconds, kept exactly below 8 us and in 8 linear sub-buckets per power of two above, so any
+// recorded value is known within 12.5%. Recording is a handful of relaxed atomic adds, safe from any thread.
+class LatencyHistogram {
+  public:
+    static constexpr int sub_buckets = 8;
+    static constexpr int max_exponent = 42; // ~50 days
+
+    void record(std::chrono::steady_clock::duration elapsed) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        uint64_t value = us > 0 ? static_cast<uint64_t>(us) : 0;
+        buckets[index(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum_us.fetch_add(value, std::memory_order_relaxed);
+        uint64_t prev_max = max_us.load(std::memory_order_relaxed);
+        while (value > prev_max && !max_us.compare_exchange_weak(prev_max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    double sum_seconds() const {
+        return sum_us.load(std::memory_order_relaxed) * 1e-6;
+    }
+
+    double max_seconds() const {
+        return max_us.load(std::memory_order_relaxed) * 1e-6;
+    }
+
+    // Number of values below us microseconds. Exact when us is a bucket edge, as every power of two is
+    uint64_t count_below(uint64_t us) const;
+
+  private:
+    static constexpr std::size_t bucket_count = (max_exponent - 1) * sub_buckets;
+
+    static std::size_t index(uint64_t us) {
+        if (us < sub_buckets) {
+            return us;
+        }
+        int exponent = std::bit_width(us) - 1; // >= 3
+        if (exponent > max_exponent) {
+            return bucket_count - 1;
+        }
+        int shift = exponent - 3;
+        return (exponent - 2) * sub_buckets + ((us >> shift) - sub_buckets);
+    }
+
+    // Largest value, in microseconds, that falls in bucket i
+    static uint64_t upper_bound(std::size_t i) {
+        if (i < sub_buckets) {
+            return i;
+        }
+        int shift = static_cast<int>(i / sub_buckets) - 1;
+        uint64_t lower = (sub_buckets + i % sub_buckets) << shift;
+        return lower + (uint64_t{ 1 } << shift) - 1;
+    }
+
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    std::atomic<uint64_t> total = 0;
+    std::atomic<uint64_t> sum_us = 0;
+    std::atomic<uint64_t> max_us = 0;
+};
+
+// One metric split by the value of a single label, series are created on first use and never removed
+template <typename T> class MetricFamily {
+  public:
+    MetricFamily(std::string name_, std::string help_, std::string label_)
+        : name(std::move(name_)), help(std::move(help_)), label(std::move(label_)) {
+    }
+
+    // The reference stays valid for the life of the family, callers may keep it
+    T &operator[](const std::string &label_value) {
+        {
+            std::shared_lock<std::shared_mutex> lock(mtx);
+            if (auto it = series.find(label_value); it != series.end()) {
+                return *it->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        auto &slot = series[label_value];
+        if (!slot) {
+            slot = std::make_unique<T>();
+        }
+        return *slot;
+    }
+
+    const std::string name;
+    const std::string help;
+    const std::string label;
+
+  private:
+    friend class Metrics;
+    mutable std::shared_mutex mtx;
+    std::map<std::string, std::unique_ptr<T>> series;
+};
+
+using HistogramFamily = MetricFamily<LatencyHistogram>;
+using CounterFamily = MetricFamily<std::atomic<uint64_t>>;
+
+// Process wide counters and latency histograms, rendered in the Prometheus text format by /REST/metrics
+class Metrics {
+  public:
+    // Send to reply time on the command socket
+    HistogramFamily command_rtt{ "rema_command_rtt_seconds", "Command round trip to the RTU", "cmd" };
+
+    // Whole REMA::execute_command, including building the request and parsing the reply
+    HistogramFamily execute_command{ "rema_execute_command_seconds", "Command execution inside the proxy", "cmd" };
+
+    HistogramFamily step{ "rema_sequence_step_seconds", "Sequence step from command to stop", "axes" };
+
+    HistogramFamily settle{ "rema_sequence_settle_seconds", "Sequence step from stop until the coords settled", "axes" };
+
+    HistogramFamily telemetry_interarrival{
+        "rema_telemetry_interarrival_seconds", "Time between telemetry arrivals, frames received together count once", "channel"
+    };
+
+    HistogramFamily telemetry_publish_latency{
+        "rema_telemetry_publish_seconds", "Telemetry frame from receive to publish", "consumer"
+    };
+
+    CounterFamily telemetry_gaps{ "rema_telemetry_gaps_total", "Telemetry interarrivals well above the usual one", "channel" };
+
+    CounterFamily watchdog_expiries{ "rema_watchdog_expiries_total", "Watchdog timer expiries", "channel" };
+
+    CounterFamily reconnects{ "rema_reconnects_total", "Reconnection attempts", "channel" };
+
+    CounterFamily frames_dropped{ "rema_frames_dropped_total", "Telemetry frames a slower pipeline stage dropped", "stage" };
+
+    CounterFamily sse_clients_evicted{ "rema_sse_clients_evicted_total", "SSE clients disconnected for falling behind", "reason" };
+
+    CounterFamily connections_lost{ "rema_connections_lost_total", "Established connections that went down", "channel" };
+
+    std::string prometheus() const;
+};
+
+// Appends a single unlabeled series to a Prometheus exposition
+void prometheus_append(std::string &out, const std::string &name, const std::string &type, const std::string &help, double value);
+
+inline Metrics metrics;
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#include "msgpack_frame.hpp"
+#include "nlohmann/json.hpp" // NLOHMANN_JSON_PASTE
+
+// Decodes msgpack straight into plain structs, without building a JSON tree and without allocating.
+// A struct becomes decodable by listing its fields with MSGPACK_DEFINE_TYPE_NON_INTRUSIVE, which also defines its
+// nlohmann mapping from the same list. Maps are matched by key, unknown keys are skipped and missing ones leave the
+// field untouched. Every read returns false, leaving the reader in an unspecified position, on malformed input.
+namespace msgpack_decode {
+
+    class Reader {
+      public:
+        Reader(const uint8_t *data, std::size_t len) : p(data), end(data + len) {
+        }
+
+        bool map_header(uint32_t &n) {
+            if (p == end) {
+                return false;
+            }
+            const uint8_t b = *p;
+            if ((b & 0xf0) == 0x80) {
+                n = b & 0x0f;
+                ++p;
+                return true;
+            }
+            if (b == 0xde || b == 0xdf) {
+                return length(b == 0xde ? 2 : 4, n);
+            }
+            return false;
+        }
+
+        bool str(std::string_view &s) {
+            if (p == end) {
+                return false;
+            }
+            const uint8_t b = *p;
+            uint32_t n;
+            if ((b & 0xe0) == 0xa0) {
+                n = b & 0x1f;
+                ++p;
+            } else if (b >= 0xd9 && b <= 0xdb) {
+                if (!length(1 << (b - 0xd9), n)) {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+            if (static_cast<std::size_t>(end - p) < n) {
+                return false;
+            }
+            s = { reinterpret_cast<const char *>(p), n };
+            p += n;
+            return true;
+        }
+
+        bool boolean(bool &v) {
+            if (p == end || (*p != 0xc2 && *p != 0xc3)) {
+                return false;
+            }
+            v = *p++ == 0xc3;
+            return true;
+        }
+
+        // Any msgpack int or float, converted to T as nlohmann's get<T>() would
+        template <typename T> bool number(T &v) {
+            if (p == end) {
+                return false;
+            }
+            const uint8_t b = *p;
+            if (b <= 0x7f) {
+                v = static_cast<T>(b);
+                ++p;
+                return true;
+            }
+            if (b >= 0xe0) {
+                v = static_cast<T>(static_cast<int8_t>(b));
+                ++p;
+                return true;
+            }
+
+            int bytes;
+            switch (b) {
+            case 0xca:
+            case 0xce:
+            case 0xd2: bytes = 4; break;
+            case 0xcb:
+            case 0xcf:
+            case 0xd3: bytes = 8; break;
+            case 0xcc:
+            case 0xd0: bytes = 1; break;
+            case 0xcd:
+            case 0xd1: bytes = 2; break;
+            default: return false;
+            }
+            if (end - p <= bytes) {
+                return false;
+            }
+            uint64_t raw = msgpack_frame::detail::be(p + 1, bytes);
+            p += 1 + bytes;
+
+            if (b == 0xca) {
+                float f;
+                uint32_t bits = static_cast<uint32_t>(raw);
+                std::memcpy(&f, &bits, sizeof(f));
+                v = static_cast<T>(f);
+            } else if (b == 0xcb) {
+                double d;
+                std::memcpy(&d, &raw, sizeof(d));
+                v = static_cast<T>(d);
+            } else if (b >= 0xd0) { // signed, sign extend from its width
+                int shift = 64 - 8 * bytes;
+                v = static_cast<T>(static_cast<int64_t>(raw << shift) >> shift);
+            } else {
+                v = static_cast<T>(raw);
+            }
+            return true;
+        }
+
+        bool skip() {
+            std::size_t size = msgpack_frame::object_size(p, end - p);
+            if (size == msgpack_frame::incomplete || size == msgpack_frame::invalid) {
+                return false;
+            }
+            p += size;
+            return true;
+        }
+
+      private:
+        bool length(int bytes, uint32_t &n) {
+            if (end - p <= bytes) {
+                return false;
+            }
+            n = static_cast<uint32_t>(msgpack_frame::detail::be(p + 1, bytes));
+            p += 1 + bytes;
+            return true;
+        }
+
+        const uint8_t *p;
+        const uint8_t *end;
+    };
+
+    inline bool read(Reader &reader, bool &v) {
+        return reader.boolean(v);
+    }
+
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    bool read(Reader &reader, T &v) {
+        return reader.number(v);
+    }
+
+    // Structs listed with MSGPACK_DEFINE_DECODER
+    template <typename T>
+        requires requires(Reader &reader, std::string_view key, T &obj) {
+            { msgpack_decode_field(reader, key, obj) } -> std::same_as<bool>;
+        }
+    bool read(Reader &reader, T &obj) {
+        uint32_t n;
+        if (!reader.map_header(n)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            std::string_view key;
+            if (!reader.str(key) || !msgpack_decode_field(reader, key, obj)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+} // namespace msgpack_decode
+
+#define MSGPACK_DECODE_FIELD(field)                                                                                    \
+    if (key == #field) {                                                                                               \
+        return msgpack_decode::read(reader, obj.field);                                                                \
+    }
+
+// Generates the key dispatch for Type: one comparison per listed field, the value decoded in place
+#define MSGPACK_DEFINE_DECODER(Type, ...)                                                                              \
+    inline bool msgpack_decode_field(msgpack_decode::Reader &reader, std::string_view key, Type &obj) {                \
+        NLOHMANN_JSON_PASTE(MSGPACK_DECODE_FIELD, __VA_ARGS__)                                                         \
+        return reader.skip();                                                                                          \
+    }
+
+// NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE plus MSGPACK_DEFINE_DECODER, from a single field list
+#define MSGPACK_DEFINE_TYPE_NON_INTRUSIVE(Type, ...)                                                                   \
+    NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Type, __VA_ARGS__)                                                              \
+    MSGPACK_DEFINE_DECODER(Type, __VA_ARGS__)
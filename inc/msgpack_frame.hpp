@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Boundary detection for a stream of concatenated msgpack objects.
+// Walks the type headers only (no decoding, no allocation) to find where the first complete object ends.
+// Used for telemetry and, once negotiated, for command replies.
+namespace msgpack_frame {
+
+    inline constexpr std::size_t incomplete = 0;
+    inline constexpr std::size_t invalid = static_cast<std::size_t>(-1);
+
+    namespace detail {
+        inline uint64_t be(const uint8_t *p, int bytes) {
+            uint64_t v = 0;
+            for (int i = 0; i < bytes; ++i) {
+                v = (v << 8) | p[i];
+            }
+            return v;
+        }
+    } // namespace detail
+
+    // Returns the size in bytes of the first complete msgpack object in [data, data + len),
+    // incomplete if more bytes are needed, or invalid if the stream can not be msgpack
+    inline std::size_t object_size(const uint8_t *data, std::size_t len) {
+        uint64_t pending = 1; // objects still to be skipped, grows with arrays and maps
+        std::size_t pos = 0;
+
+        while (pending > 0) {
+            if (pos >= len) {
+                return incomplete;
+            }
+            const uint8_t b = data[pos];
+            --pending;
+
+            int len_bytes = 0;      // size of the length field following the type byte
+            uint64_t payload = 0;   // fixed payload size after the length field
+            int extra = 0;          // ext type byte
+            enum { none, raw, array, map } kind = none;
+
+            if (b <= 0x7f || b >= 0xe0) { // positive / negative fixint
+            } else if (b <= 0x8f) {
+                pending += 2 * (b & 0x0f);
+            } else if (b <= 0x9f) {
+                pending += b & 0x0f;
+            } else if (b <= 0xbf) {
+                payload = b & 0x1f;
+            } else {
+                switch (b) {
+                case 0xc0:
+                case 0xc2:
+                case 0xc3: break;
+                case 0xc4: len_bytes = 1; kind = raw; break;
+                case 0xc5: len_bytes = 2; kind = raw; break;
+                case 0xc6: len_bytes = 4; kind = raw; break;
+                case 0xc7: len_bytes = 1; kind = raw; extra = 1; break;
+                case 0xc8: len_bytes = 2; kind = raw; extra = 1; break;
+                case 0xc9: len_bytes = 4; kind = raw; extra = 1; break;
+                case 0xca: payload = 4; break;
+                case 0xcb: payload = 8; break;
+                case 0xcc: payload = 1; break;
+                case 0xcd: payload = 2; break;
+                case 0xce: payload = 4; break;
+                case 0xcf: payload = 8; break;
+                case 0xd0: payload = 1; break;
+                case 0xd1: payload = 2; break;
+                case 0xd2: payload = 4; break;
+                case 0xd3: payload = 8; break;
+                case 0xd4: payload = 2; break;
+                case 0xd5: payload = 3; break;
+                case 0xd6: payload = 5; break;
+                case 0xd7: payload = 9; break;
+                case 0xd8: payload = 17; break;
+                case 0xd9: len_bytes = 1; kind = raw; break;
+                case 0xda: len_bytes = 2; kind = raw; break;
+                case 0xdb: len_bytes = 4; kind = raw; break;
+                case 0xdc: len_bytes = 2; kind = array; break;
+                case 0xdd: len_bytes = 4; kind = array; break;
+                case 0xde: len_bytes = 2; kind = map; break;
+                case 0xdf: len_bytes = 4; kind = map; break;
+                default: return invalid; // 0xc1 is never used
+                }
+            }
+            ++pos;
+
+            if (len_bytes) {
+                if (len - pos < static_cast<std::size_t>(len_bytes)) {
+                    return incomplete;
+                }
+                uint64_t n = detail::be(data + pos, len_bytes);
+                pos += len_bytes;
+                switch (kind) {
+                case raw: payload = n + extra; break;
+                case array: pending += n; break;
+                case map: pending += 2 * n; break;
+                default: break;
+                }
+            }
+
+            if (len - pos < payload) {
+                return incomplete;
+            }
+            pos += payload;
+        }
+        return pos;
+    }
+
+    // Tells whether a complete frame is a map, as replies are, rather than some other msgpack object
+    inline bool is_map(uint8_t first_byte) {
+        return (first_byte & 0xf0) == 0x80 || first_byte == 0xde || first_byte == 0xdf;
+    }
+
+    // Value of an unsigned integer under key in the top level map of a complete frame, 0 if there is none.
+    // Other entries are skipped with object_size(), nothing is decoded
+    inline uint64_t find_uint(const uint8_t *data, std::size_t len, std::string_view key) {
+        if (len == 0 || !is_map(data[0])) {
+            return 0;
+        }
+        std::size_t pos = 1;
+        uint64_t entries = data[0] & 0x0f;
+        if (data[0] == 0xde || data[0] == 0xdf) {
+            int bytes = data[0] == 0xde ? 2 : 4;
+            if (len < 1u + bytes) {
+                return 0;
+            }
+            entries = detail::be(data + 1, bytes);
+            pos += bytes;
+        }
+
+        for (uint64_t i = 0; i < entries && pos < len; ++i) {
+            // keys the proxy looks for are short, so only fixstr keys can match
+            const uint8_t k = data[pos];
+            bool match = (k & 0xe0) == 0xa0 && (k & 0x1f) == key.size() && len - pos > key.size() &&
+                         std::memcmp(data + pos + 1, key.data(), key.size()) == 0;
+
+            std::size_t key_size = object_size(data + pos, len - pos);
+            if (key_size == incomplete || key_size == invalid) {
+                return 0;
+            }
+            pos += key_size;
+            if (pos >= len) {
+                return 0;
+            }
+
+            if (match) {
+                const uint8_t v = data[pos];
+                if (v <= 0x7f) {
+                    return v;
+                }
+                if (v >= 0xcc && v <= 0xcf) {
+                    int bytes = 1 << (v - 0xcc);
+                    return len - pos > static_cast<std::size_t>(bytes) ? detail::be(data + pos + 1, bytes) : 0;
+                }
+                return 0;
+            }
+
+            std::size_t value_size = object_size(data + pos, len - pos);
+            if (value_size == incomplete || value_size == invalid) {
+                return 0;
+            }
+            pos += value_size;
+        }
+        return 0;
+    }
+
+} // namespace msgpack_frame
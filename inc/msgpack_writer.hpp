@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Minimal msgpack encoder appending to a caller owned buffer, for the few fixed shapes the proxy sends.
+// Reusing the buffer between messages makes encoding allocation free once it has grown to size.
+namespace msgpack_writer {
+
+    namespace detail {
+        inline void be(std::string &out, uint64_t v, int bytes) {
+            for (int i = bytes - 1; i >= 0; --i) {
+                out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+            }
+        }
+    } // namespace detail
+
+    inline void array_header(std::string &out, uint32_t n) {
+        if (n < 16) {
+            out.push_back(static_cast<char>(0x90 | n));
+        } else if (n <= 0xffff) {
+            out.push_back(static_cast<char>(0xdc));
+            detail::be(out, n, 2);
+        } else {
+            out.push_back(static_cast<char>(0xdd));
+            detail::be(out, n, 4);
+        }
+    }
+
+    inline void map_header(std::string &out, uint32_t n) {
+        if (n < 16) {
+            out.push_back(static_cast<char>(0x80 | n));
+        } else if (n <= 0xffff) {
+            out.push_back(static_cast<char>(0xde));
+            detail::be(out, n, 2);
+        } else {
+            out.push_back(static_cast<char>(0xdf));
+            detail::be(out, n, 4);
+        }
+    }
+
+    inline void str(std::string &out, std::string_view s) {
+        if (s.size() < 32) {
+            out.push_back(static_cast<char>(0xa0 | s.size()));
+        } else if (s.size() <= 0xff) {
+            out.push_back(static_cast<char>(0xd9));
+            detail::be(out, s.size(), 1);
+        } else if (s.size() <= 0xffff) {
+            out.push_back(static_cast<char>(0xda));
+            detail::be(out, s.size(), 2);
+        } else {
+            out.push_back(static_cast<char>(0xdb));
+            detail::be(out, s.size(), 4);
+        }
+        out.append(s);
+    }
+
+    inline void uint(std::string &out, uint64_t v) {
+        if (v < 0x80) {
+            out.push_back(static_cast<char>(v));
+        } else if (v <= 0xff) {
+            out.push_back(static_cast<char>(0xcc));
+            detail::be(out, v, 1);
+        } else if (v <= 0xffff) {
+            out.push_back(static_cast<char>(0xcd));
+            detail::be(out, v, 2);
+        } else if (v <= 0xffffffff) {
+            out.push_back(static_cast<char>(0xce));
+            detail::be(out, v, 4);
+        } else {
+            out.push_back(static_cast<char>(0xcf));
+            detail::be(out, v, 8);
+        }
+    }
+
+} // namespace msgpack_writer
@@ -9,42 +9,136 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "reactor.hpp"
+#include "active.hpp"
+#include "frame_buffer.hpp"
+
+// Non-blocking TCP client driven by a Reactor.
+// Connecting, reading and tearing down the socket all happen on the reactor thread; received bytes are appended to
+// rx_buffer_ and handed to on_data(), which subclasses override to split them into frames. A frame longer than
+// max_frame_size drops the connection.
 class NetClient {
   public:
-    NetClient();
+    explicit NetClient(std::size_t min_read_size = 4096, std::size_t max_frame_size = 1 << 20);
     virtual ~NetClient() = default;
 
-    virtual int connect(std::string host, int port, int nsec = 5);
+    void set_reactor(Reactor &reactor) {
+        reactor_ = &reactor;
+    }
+
+    // Blocks the caller (never call it from the reactor thread) until connected or nsec elapsed. 0 waits forever
+    int connect(std::string host, int port, int nsec = 5);
+
+    // Starts connecting and returns at once. The future holds 0 on success or -errno
+    std::future<int> connect_async(std::string host, int port);
+
+    // Same, on_done gets the result on the reactor thread. It is never called if the attempt is dropped by close()
+    void connect_async(std::string host, int port, std::function<void(int)> on_done);
+
+    // Reactor thread: an established connection went down, for whatever reason
+    void set_on_connection_lost(std::function<void()> callback) {
+        on_connection_lost = callback;
+    }
+
+    // Waits for connect_async(), giving up and dropping the attempt at deadline
+    int wait_connected(std::future<int> &connected, std::chrono::steady_clock::time_point deadline);
 
     virtual void close();
 
     virtual void reconnect();
 
-    bool send_request(std::string);
+    // Any thread. Waits up to 1 s at a time for the kernel to take more. A request that could only be partly sent closes
+    // the connection
+    bool send_request(const std::string &request);
 
-    std::string get_response();
-    
-    std::vector<uint8_t> get_response_binary();
+    // Free space made before each read, which then takes all the free space there is
+    void set_min_read_size(std::size_t min_read_size) {
+        min_read_size_ = min_read_size;
+    }
 
     int get_port() {
+        std::lock_guard<std::mutex> lock(socket_mtx_);
         return port_;
     }
 
     std::string get_host() {
+        std::lock_guard<std::mutex> lock(socket_mtx_);
         return host_;
     }
 
-    volatile bool is_connected = false;
+    std::atomic<bool> is_connected = false;
+
+  protected:
+    // Reactor thread: the connection was just established
+    virtual void on_connected() {
+    }
+
+    // Reactor thread: new bytes were appended to rx_buffer_
+    virtual void on_data() {
+    }
+
+    // Before connecting: ask the kernel to timestamp received data, see last_rx_time()
+    void enable_rx_timestamps() {
+        rx_timestamps_wanted_ = true;
+    }
+
+    // Reactor thread: whether this connection got kernel timestamps, SO_TIMESTAMPING is not available everywhere
+    bool kernel_rx_timestamps() const {
+        return kernel_rx_timestamps_;
+    }
+
+    // Reactor thread, in on_data(): when the last bytes read arrived. The kernel's software receive timestamp when
+    // available, otherwise the time they were read
+    std::chrono::steady_clock::time_point last_rx_time() const {
+        return last_rx_time_;
+    }
+
+    // Reactor thread: the socket was closed, by the peer or by us
+    virtual void on_disconnected() {
+    }
+
+    FrameBuffer rx_buffer_;
 
   private:
-    std::string host_;
-    int port_;
-    volatile int socket_;
-    int buflen_ = 1024;
-    char* buf_ = new char[buflen_];
-    std::string leftover_buffer; // Buffer for data after '\0'
+    void handle_events(uint32_t events);
+
+    void connect_resolved(const std::string &host,
+                          int port,
+                          const struct sockaddr_storage &server_addr,
+                          socklen_t server_addr_len,
+                          int family,
+                          std::function<void(int)> on_done);
+
+    void teardown();
+
+    ssize_t receive(char *dst, std::size_t room);
+
+    std::string host_; // under socket_mtx_, the last endpoint asked for
+    int port_ = 0;
+    int socket_ = -1;
+    int socket_port_ = 0; // reactor thread only, the port socket_ connects to
+    std::size_t min_read_size_;
+    Reactor *reactor_ = nullptr;
+    std::mutex send_mtx_;   // senders among themselves, held while waiting for the socket to take more
+    std::mutex socket_mtx_; // senders vs. teardown, never held while waiting
+    uint64_t connection_ = 0; // under socket_mtx_, counts sockets so that a sender notices a new one with the same fd
+    bool established_ = false; // reactor thread only, is_connected is also cleared by other threads
+    bool rx_timestamps_wanted_ = false;
+    bool kernel_rx_timestamps_ = false; // reactor thread only
+    std::chrono::steady_clock::time_point last_rx_time_; // reactor thread only
+    std::function<void()> on_connection_lost;
+    std::atomic<uint64_t> connect_attempt_ = 0; // a resolved address is only used by the latest attempt
+    Active resolver_; // Last, so that its thread is gone before anything it uses
 };
@@ -2,6 +2,7 @@
 
 #include <cfloat>
 
+#include "msgpack_decode.hpp"
 #include "nlohmann/json.hpp"
 #include <spdlog/spdlog.h>
 
@@ -97,4 +98,4 @@ class Point3D {
     double y = 0;
     double z = 0;
 };
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Point3D, x, y, z)
+MSGPACK_DEFINE_TYPE_NON_INTRUSIVE(Point3D, x, y, z)
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Single epoll loop shared by the RTU connections.
+// File descriptors are only registered, modified and removed from the loop thread itself (use post() from any other
+// thread), so a handler never runs for a descriptor that has already been torn down.
+class Reactor {
+  public:
+    using Handler = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+
+    Reactor();
+
+    ~Reactor();
+
+    // Joins the loop thread, tasks posted afterwards never run. Not from the loop thread itself
+    void stop();
+
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    // Loop thread only
+    bool add(int fd, uint32_t events, Handler handler);
+
+    bool modify(int fd, uint32_t events, Handler handler);
+
+    void remove(int fd);
+
+    // Thread safe, tasks run on the loop thread in the order they were posted
+    void post(Task task);
+
+    // Thread safe, runs task on the loop thread once delay has elapsed
+    void post_after(std::chrono::steady_clock::duration delay, Task task);
+
+    bool in_loop_thread() const {
+        return std::this_thread::get_id() == thd.get_id();
+    }
+
+  private:
+    void run(std::stop_token stop_token);
+
+    void wakeup();
+
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::map<int, Handler> handlers;
+    std::mutex tasks_mtx;
+    std::vector<Task> tasks;
+    std::multimap<std::chrono::steady_clock::time_point, Task> timers;
+    std::jthread thd;
+};
@@ -1,17 +1,28 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <filesystem>
 #include <mutex>
 #include <string>
+#include <thread>
 
 #include "command_net_client.hpp"
+#include "connection_supervisor.hpp"
 #include "nlohmann/json.hpp"
+#include "telemetry_history.hpp"
 #include "telemetry_net_client.hpp"
 #include "logs_net_client.hpp"
+#include "reactor.hpp"
+#include "rtu_log.hpp"
+#include "seqlock.hpp"
+#include "settle_detector.hpp"
+#include "spsc_queue.hpp"
 #include "tl/expected.hpp"
 #include "points.hpp"
 #include "session.hpp"
 #include "tool.hpp"
+#include "tool_registry.hpp"
 #include "telemetry.hpp"
 #include "log_pattern.hpp"
 #include "magic_enum/magic_enum.hpp"
@@ -24,10 +35,14 @@ inline const std::filesystem::path logs_dir = "logs";
 struct temps {
     double x, y, z;
 };
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(temps, x, y, z)
+MSGPACK_DEFINE_TYPE_NON_INTRUSIVE(temps, x, y, z)
 
 enum speed {SLOW, NORMAL};
 
+// These value goes into bresenham error determination that needs to be multiplied by 2
+constexpr int MAX_POSITIVE_SETPOINT = 999999999;
+constexpr int MAX_NEGATIVE_SETPOINT = -MAX_POSITIVE_SETPOINT;
+
 struct movement_cmd {
     std::string axes;
     enum speed speed = speed::NORMAL;
@@ -39,20 +54,35 @@ struct movement_cmd {
         Point3D coords;
         bool stopped_on_probe;
         bool stopped_on_condition;
+        bool settled;
+        std::chrono::milliseconds settle_time;  // From the stop until the coords settled, or the settle timeout
     } execution_results;
 };
 
 class REMA {
   public:
-    static void add_tool(const Tool &tool);
+    // Current snapshot of the tools, never blocks
+    std::shared_ptr<const ToolRegistry> tool_registry() const {
+        return tools_.load(std::memory_order_acquire);
+    }
+
+    void add_tool(const Tool &tool);
+
+    void delete_tool(const std::string &tool);
 
-    static void delete_tool(const std::string &tool);
+    void set_tools_ui_scale(double ui_scale);
 
     void connect(const std::string &rtu_host, int rtu_port);
 
     void reconnect();
 
-    void update_telemetry(std::vector<uint8_t>& stream);
+    void update_telemetry(std::span<const uint8_t> frame, std::chrono::steady_clock::time_point received_at);
+
+    void run_ui_stage();
+
+    bool wait_for_telemetry(uint64_t version, std::chrono::milliseconds timeout);
+
+    void notify_telemetry_waiters();
     
     void save_logs(std::string &stream);
     
@@ -74,12 +104,16 @@ class REMA {
 
     nlohmann::json send_startup_commands();
 
+    std::future<std::string> execute_command_async(const std::string cmd_name, const nlohmann::json pars = {});
+
     void execute_command_no_wait(const std::string cmd_name, const nlohmann::json command);
 
     nlohmann::json execute_command(const std::string cmd_name, const nlohmann::json pars = {});
 
     nlohmann::json move_closed_loop(movement_cmd cmd);
 
+    tl::expected<nlohmann::json, std::string> move_joystick(const std::string &dir);
+
     void axes_hard_stop_all();
 
     void axes_soft_stop_all();
@@ -101,6 +135,8 @@ class REMA {
 
     REMA();
 
+    ~REMA();
+
     // C++ 11
     // =======
     // We can use the better technique of deleting the methods
@@ -117,29 +153,39 @@ class REMA {
     //       before deleted status
 
     bool loaded = false;
-    static std::map<std::string, Tool> tools;
-    std::string last_selected_tool;
-    CommandNetClient command_client;
-    TelemetryNetClient telemetry_client;
-    LogsNetClient logs_client;
     volatile bool is_sequence_in_progress;
-    volatile bool cancel_sequence;
+    std::atomic<bool> cancel_sequence = false;
     nlohmann::json config;
-
-    // Telemetry values
-    std::mutex mtx;
-    struct telemetry telemetry;
-    struct telemetry ui_telemetry;
-    struct telemetry old_telemetry;
-    struct temps temps;
-    volatile bool new_temps_available;
-
-    std::vector<std::string> logs_vector;
-    std::ofstream logs_ofstream;
+    SettleDetector::Params settle_params;   // config.json "REMA": {"settle": {"window", "tolerance", "timeout_ms"}}
+
+    // Telemetry values, published by update_telemetry() on the reactor thread, and ui_telemetry by the UI stage.
+    // Readers take a snapshot with load()
+    Seqlock<struct telemetry> telemetry;
+    Seqlock<struct telemetry> ui_telemetry;
+    Seqlock<struct temps> temps;
+    TelemetryHistory telemetry_history{ 8192 }; // About 13 minutes at 10 frames per second
+    SpscQueue<TelemetryHistory::Entry, 64> ui_queue; // Decoded frames, from update_telemetry() to the UI stage
+    std::atomic<std::chrono::steady_clock::time_point> ui_telemetry_received_at; // Of the frame in ui_telemetry, or a
+                                                                                 // newer one for a moment
+    struct telemetry old_telemetry; // Only touched by the UI stage
+    std::mutex telemetry_update_mtx;
+    std::condition_variable telemetry_updated; // Notified on every published frame and on cancellation
+
+    RtuLog rtu_log;
     std::string rtu_host_;
     int rtu_port_;
-    std::mutex rtu_mutex;
+    std::atomic<std::shared_ptr<const ToolRegistry>> tools_{ std::make_shared<const ToolRegistry>() };
+    std::mutex tools_edit_mtx;  // Serializes edits so that none is lost, readers never take it
+    std::mutex tool_select_mtx; // Serializes tool changes, held while the touch probe moves
+
+    // ~REMA() stops the reactor before any member is destroyed, its callbacks reach most of them. The reactor object
+    // itself outlives the clients and the supervisor, which may still post to it while their own threads wind down
+    Reactor reactor;
+    CommandNetClient command_client;
+    TelemetryNetClient telemetry_client;
+    LogsNetClient logs_client;
+    ConnectionSupervisor supervisor{ reactor };
+    std::jthread ui_stage;  // Last, so that it is stopped before anything it uses is destroyed
 };
 
-inline std::map<std::string, Tool> REMA::tools;
 inline REMA rema;
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The log lines sent by the RTU. The last max_kept are kept for the logs page, numbered from 0 in arrival order, so
+// that a page can ask for the lines after the last one it has. Every line is appended to a file by a thread of its
+// own, so the reactor thread that receives them never waits on the disk
+class RtuLog {
+  public:
+    static constexpr std::size_t max_kept = 10000;
+
+    struct Lines {
+        std::vector<std::string> lines;
+        uint64_t next = 0; // Number of the line after them
+    };
+
+    ~RtuLog() {
+        close();
+    }
+
+    // Appends to path. Returns false if it can't be opened, lines are still kept for the logs page then
+    bool open(const std::filesystem::path &path);
+
+    // Writes out whatever is still queued
+    void close();
+
+    // Any thread
+    void add(const std::string &line);
+
+    // The kept lines numbered from `from` up to `until`, excluded, oldest first. Lines that already left the ring are
+    // skipped
+    Lines since(uint64_t from, uint64_t until = std::numeric_limits<uint64_t>::max()) const;
+
+  private:
+    void write_queued(std::stop_token stop);
+
+    mutable std::mutex mtx; // Guards writing, kept, added and unwritten. Never held while writing to disk
+    std::condition_variable_any unwritten_cv;
+    std::deque<std::string> kept;
+    uint64_t added = 0;
+    std::vector<std::string> unwritten;
+    bool writing = false;
+    std::ofstream file; // Writer thread only while it runs
+    std::jthread writer;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+// Snapshot of a small trivially copyable value, published by a single writer and read by any number of threads.
+// The writer never waits. A reader copies the value out and retries only if a store overlapped the copy, so it
+// always gets one whole published value and never a mix of two. The payload is kept in atomic words, which keeps
+// the concurrent copies free of data races.
+// T may still have default member initializers or a default constructor of its own, like struct telemetry
+template <typename T>
+class Seqlock {
+    static_assert(std::is_trivially_copyable_v<T>, "Seqlock copies its value byte by byte");
+    static_assert(std::is_default_constructible_v<T>, "Seqlock::load() builds the value it copies into");
+
+  public:
+    Seqlock() {
+        store(T{});
+    }
+
+    explicit Seqlock(const T &value) {
+        store(value);
+    }
+
+    Seqlock(const Seqlock &) = delete;
+    Seqlock &operator=(const Seqlock &) = delete;
+
+    // Single writer at a time
+    void store(const T &value) {
+        Words words{};
+        std::memcpy(words.data(), &value, sizeof(T));
+
+        uint64_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed); // odd while writing
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < word_count; ++i) {
+            data_[i].store(words[i], std::memory_order_relaxed);
+        }
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    T load() const {
+        Words words;
+        while (true) {
+            uint64_t before = seq_.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield(); // the writer is halfway, it won't be long
+                continue;
+            }
+            for (std::size_t i = 0; i < word_count; ++i) {
+                words[i] = data_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == before) {
+                break;
+            }
+        }
+        T value;
+        std::memcpy(static_cast<void *>(&value), words.data(), sizeof(T)); // Fine for any trivially copyable T
+        return value;
+    }
+
+    // Bumped by every store, lets readers tell whether anything was published since they last looked
+    uint64_t version() const {
+        return seq_.load(std::memory_order_acquire) / 2;
+    }
+
+  private:
+    static constexpr std::size_t word_count = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    using Words = std::array<uint64_t, word_count>;
+
+    std::atomic<uint64_t> seq_ = 0;
+    std::array<std::atomic<uint64_t>, word_count> data_{};
+};
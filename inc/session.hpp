@@ -75,6 +75,9 @@ class Session {
 
     void save_to_disk() const;
 
+    // Flags unsaved changes and publishes them
+    void mark_changed();
+
     void set_selected_plan(std::string& plan);
 
     std::string get_selected_plan() const;
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "points.hpp"
+
+// Tells when the axes have come to rest after a move, from consecutive telemetry coordinates.
+// The position is settled once the spread (standard deviation, per axis) of the last window samples falls below
+// tolerance, in REMA units.
+class SettleDetector {
+  public:
+    struct Params {
+        std::size_t window = 3;
+        double tolerance = 0.005;
+        std::chrono::milliseconds timeout{ 1000 };
+    };
+
+    explicit SettleDetector(const Params &params) : params_(params), samples_(std::max<std::size_t>(params.window, 2)) {
+    }
+
+    // Adds a sample, returns true if the last window samples are settled
+    bool add(const Point3D &coords) {
+        samples_[next_] = coords;
+        next_ = (next_ + 1) % samples_.size();
+        count_ = std::min(count_ + 1, samples_.size());
+        if (count_ < samples_.size()) {
+            return false;
+        }
+
+        Point3D mean;
+        for (const auto &sample : samples_) {
+            mean += sample;
+        }
+        mean /= static_cast<double>(samples_.size());
+
+        Point3D variance;
+        for (const auto &sample : samples_) {
+            Point3D d = sample - mean;
+            variance += Point3D(d.x * d.x, d.y * d.y, d.z * d.z);
+        }
+        variance /= static_cast<double>(samples_.size());
+
+        double limit = params_.tolerance * params_.tolerance;
+        return variance.x <= limit && variance.y <= limit && variance.z <= limit;
+    }
+
+  private:
+    Params params_;
+    std::vector<Point3D> samples_;
+    std::size_t next_ = 0;
+    std::size_t count_ = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock free queue between exactly one producer thread and one consumer thread.
+// Storage is allocated with the queue; pushing never blocks or allocates and fails instead when the queue is full.
+// The consumer can sleep in pop() until something arrives or the queue is closed.
+template <typename T, std::size_t Capacity> class SpscQueue {
+    static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  public:
+    // Producer
+    bool try_push(const T &value) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots_[tail & (Capacity - 1)] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        events_.fetch_add(1, std::memory_order_release);
+        events_.notify_one();
+        return true;
+    }
+
+    // Consumer
+    bool try_pop(T &value) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots_[head & (Capacity - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer, waits for an element. Returns false once the queue is closed
+    bool pop(T &value) {
+        while (true) {
+            uint32_t seen = events_.load(std::memory_order_acquire);
+            if (closed_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (try_pop(value)) {
+                return true;
+            }
+            events_.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    // Any thread, wakes the consumer for good
+    void close() {
+        closed_.store(true, std::memory_order_release);
+        events_.fetch_add(1, std::memory_order_release);
+        events_.notify_all();
+    }
+
+  private:
+    std::array<T, Capacity> slots_{};
+    alignas(64) std::atomic<uint64_t> head_ = 0;
+    alignas(64) std::atomic<uint64_t> tail_ = 0;
+    alignas(64) std::atomic<uint32_t> events_ = 0; // Bumped on every push and on close, what the consumer sleeps on
+    std::atomic<bool> closed_ = false;
+};
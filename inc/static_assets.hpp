@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <restbed>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "cached_content.hpp"
+
+namespace http_headers {
+
+    // True if Accept-Encoding takes the coding: by name if it is listed, else through *, in both cases without q=0
+    bool accepts(const std::string &accept_encoding, std::string_view coding);
+
+    // True if If-None-Match names the hash. It compares weakly: W/ and the encoding suffix don't matter
+    bool none_match(const std::string &if_none_match, const std::string &hash);
+
+} // namespace http_headers
+
+// 200 in the best encoding the request accepts, or 304 when If-None-Match names the content's hash
+void send_cached(const std::shared_ptr<restbed::Session> &session, const CachedContent &content,
+                 const std::string &cache_control);
+
+// wwwroot in memory, loaded at start. inotify drops a file as soon as it changes on disk and the next request reads
+// it again, so editing the pages doesn't need a restart. Without inotify the files stay as loaded
+class StaticAssets {
+  public:
+    explicit StaticAssets(std::filesystem::path root_dir) : root(std::move(root_dir)) {
+    }
+
+    // Loads every file and starts watching
+    void start();
+
+    // relative to root, nullptr if there is no such file
+    std::shared_ptr<const CachedContent> find(const std::string &relative);
+
+  private:
+    std::shared_ptr<const CachedContent> load(const std::string &relative) const;
+
+    void add_watches(const std::string &relative);
+
+    void watch(std::stop_token stop);
+
+    void invalidate(const std::string &relative);
+
+    const std::filesystem::path root;
+
+    std::mutex mtx;
+    std::map<std::string, std::shared_ptr<const CachedContent>> assets; // By path relative to root
+    uint64_t generation = 0; // Invalidations so far, so that a load racing with one isn't kept
+
+    int inotify_fd = -1;
+    std::map<int, std::string> directories; // By watch descriptor, relative to root. Watcher thread once started
+    std::jthread watcher;    // Last, so that it is stopped before anything it uses is destroyed
+};
+
+inline StaticAssets static_assets{ "./wwwroot" };
@@ -2,14 +2,17 @@
 
 #include <nlohmann/json.hpp>
 
+#include <msgpack_decode.hpp>
 #include <points.hpp>
 
 struct individual_axes {
     bool x;
     bool y;
     bool z;
+
+    bool operator==(const individual_axes &) const = default;
 };
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(individual_axes, x, y, z)
+MSGPACK_DEFINE_TYPE_NON_INTRUSIVE(individual_axes, x, y, z)
 
 struct limits {
     bool left;
@@ -19,14 +22,18 @@ struct limits {
     bool in;
     bool out;
     bool probe;
+
+    bool operator==(const limits &) const = default;
 };
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(limits, left, right, up, down, in, out, probe)
+MSGPACK_DEFINE_TYPE_NON_INTRUSIVE(limits, left, right, up, down, in, out, probe)
 
 struct compound_axes {
     bool x_y = false;
     bool z = false;
+
+    bool operator==(const compound_axes &) const = default;
 };
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(compound_axes, x_y, z)
+MSGPACK_DEFINE_TYPE_NON_INTRUSIVE(compound_axes, x_y, z)
 
 struct telemetry {
     struct Point3D coords;
@@ -41,7 +48,7 @@ struct telemetry {
     int brakes_mode;
     bool probe_protected;
 };
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(
+MSGPACK_DEFINE_TYPE_NON_INTRUSIVE(
     telemetry,
     coords,
     targets,
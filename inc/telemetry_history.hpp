@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "seqlock.hpp"
+#include "telemetry.hpp"
+
+// The last frames of telemetry with the monotonic time they were received, in a ring allocated once.
+// A single writer pushes frames without ever waiting. Any number of readers can query a time range at the same
+// time. They find where it starts with a binary search over the timestamps.
+class TelemetryHistory {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    struct Entry {
+        clock::time_point time;
+        struct telemetry telemetry;
+    };
+
+    explicit TelemetryHistory(std::size_t capacity)
+        : capacity_(capacity), slots_(std::make_unique<Seqlock<Entry>[]>(capacity)) {
+    }
+
+    // Single writer, time must not go backwards
+    void push(clock::time_point time, const struct telemetry &telemetry) {
+        uint64_t n = written_.load(std::memory_order_relaxed);
+        slots_[n % capacity_].store({ time, telemetry });
+        written_.store(n + 1, std::memory_order_release);
+    }
+
+    // Entries received within [since, until], oldest first. A reader that falls a whole ring behind the writer gets
+    // the range cut short where the writer overtook it
+    std::vector<Entry> range(clock::time_point since, clock::time_point until) const {
+        uint64_t end = written_.load(std::memory_order_acquire);
+        uint64_t begin = end > capacity_ ? end - capacity_ : 0;
+
+        uint64_t lo = begin;
+        uint64_t hi = end;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (slot(mid).time < since) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        std::vector<Entry> entries;
+        for (uint64_t i = lo; i < end; ++i) {
+            Entry entry = slot(i);
+            if (entry.time > until || (!entries.empty() && entry.time < entries.back().time)) {
+                break;
+            }
+            if (entry.time >= since) {
+                entries.push_back(entry);
+            }
+        }
+        return entries;
+    }
+
+    // The last n entries or fewer, oldest first
+    std::vector<Entry> latest(std::size_t n) const {
+        uint64_t end = written_.load(std::memory_order_acquire);
+        uint64_t begin = end - std::min<uint64_t>({ end, n, capacity_ });
+        std::vector<Entry> entries;
+        entries.reserve(end - begin);
+        for (uint64_t i = begin; i < end; ++i) {
+            entries.push_back(slot(i));
+        }
+        return entries;
+    }
+
+    std::size_t capacity() const {
+        return capacity_;
+    }
+
+  private:
+    Entry slot(uint64_t n) const {
+        return slots_[n % capacity_].load();
+    }
+
+    const std::size_t capacity_;
+    std::unique_ptr<Seqlock<Entry>[]> slots_;
+    std::atomic<uint64_t> written_ = 0;
+};
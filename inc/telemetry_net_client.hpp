@@ -1,11 +1,16 @@
 #pragma once
 
+#include "link_quality.hpp"
+#include "metrics.hpp"
+#include "msgpack_frame.hpp"
 #include "net_client.hpp"
+#include "traffic_recorder.hpp"
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
 #include <iostream>
 #include <memory>
 #include <restbed>
+#include <span>
 #include <spdlog/spdlog.h>
 #include <string>
 #include <thread>
@@ -13,17 +18,21 @@
 
 class TelemetryNetClient : public NetClient {
   public:    
-    TelemetryNetClient() = default;
+    TelemetryNetClient() {
+        enable_rx_timestamps();
+    }
 
-    void set_on_receive_callback(std::function<void(std::vector<uint8_t>&)> onReceiveCallback) {
+    // The callback gets each frame with the time it was received
+    void set_on_receive_callback(
+        std::function<void(std::span<const uint8_t>, std::chrono::steady_clock::time_point)> onReceiveCallback) {
         onReceiveCb = onReceiveCallback;
     }
 
     void start() {
         if (!alreadyStarted && onReceiveCb) {
-            thd = std::jthread(&TelemetryNetClient::loop, this);
             disconnect_watchdog.onTimeoutCallback = [&] { 
                 SPDLOG_WARN("Telemetry watchdog timer expired. Closing connection");
+                ++metrics.watchdog_expiries["telemetry"];
                 close(); 
             };
             disconnect_watchdog.start(std::chrono::seconds(2));
@@ -35,37 +44,73 @@ class TelemetryNetClient : public NetClient {
         NetClient::close();        
     }
 
-    int connect(std::string host, int port, int nsec = 0) override {
-        nsec = (nsec == 0 ? ConnectionTimeout : nsec);
-        if (int n; (n = NetClient::connect(host, port, nsec)) < 0) {
-            return n;
-        }
+    // Hands a frame that didn't come from the socket, a replayed one, to the same path as received frames.
+    // Not to be mixed with a live connection
+    void inject(std::span<const uint8_t> frame) {
+        auto now = std::chrono::steady_clock::now();
+        deliver(frame, now);
+        arrived(now, 1);
+    }
+
+    std::function<void(std::span<const uint8_t>, std::chrono::steady_clock::time_point)> onReceiveCb;
+    bool alreadyStarted = false;
+    std::atomic<uint64_t> frames_received = 0;
+    std::atomic<uint64_t> frames_undecodable = 0;
+    LinkQuality link_quality;
+    WatchdogTimer disconnect_watchdog;
+
+  protected:
+    LatencyHistogram &interarrival = metrics.telemetry_interarrival["telemetry"];
+    std::chrono::steady_clock::time_point last_frame_at; // reactor thread only
+
+    void on_connected() override {
+        last_frame_at = {}; // the gap since the previous connection is not jitter
+        link_quality.connected(kernel_rx_timestamps());
         disconnect_watchdog.resume();
-        cv.notify_all();      // NetClient::connect will change is_connected to true if successful
-        return 0;
     }
 
-    void loop(std::stop_token stop_token) {
-        while (!stop_token.stop_requested()) {
-            {
-                std::unique_lock<std::mutex> lock(mtx);
-                cv.wait(lock, [this] { return is_connected; });
-            }
+    // Splits the buffered bytes into msgpack objects. A partial object stays buffered until the rest arrives and
+    // objects merged in a single read are delivered one at a time
+    void on_data() override {
+        // Frames completed by the same read share its receive time, and are accounted as a single arrival
+        auto now = last_rx_time();
+        std::size_t frames = 0;
+        while (true) {
+            std::string_view pending = rx_buffer_.data();
+            auto bytes = reinterpret_cast<const uint8_t *>(pending.data());
+            std::size_t size = msgpack_frame::object_size(bytes, pending.size());
 
-            std::vector<uint8_t> line = get_response_binary();
-            if (!line.empty()) {
-                // std::cout << "t" << std::flush;
-                onReceiveCb(line);
-                disconnect_watchdog.reset();
+            if (size == msgpack_frame::invalid) {
+                SPDLOG_ERROR("Telemetry stream out of sync, dropping {} bytes", pending.size());
+                ++frames_undecodable;
+                rx_buffer_.clear();
+                break;
             }
+            if (size == msgpack_frame::incomplete) {
+                break;
+            }
+
+            rx_buffer_.consume(size);
+            traffic_recorder.record(traffic::Record::TELEMETRY, { bytes, size });
+            deliver({ bytes, size }, now);
+            ++frames;
+            disconnect_watchdog.reset();
+        }
+        if (frames > 0) {
+            arrived(now, frames);
         }
     }
 
-    std::function<void(std::vector<uint8_t>&)> onReceiveCb;
-    std::jthread thd;
-    std::mutex mtx;
-    std::condition_variable cv;    
-    bool alreadyStarted = false;
-    int ConnectionTimeout = 5;
-    WatchdogTimer disconnect_watchdog;
+    void deliver(std::span<const uint8_t> frame, std::chrono::steady_clock::time_point now) {
+        ++frames_received;
+        onReceiveCb(frame, now);
+    }
+
+    void arrived(std::chrono::steady_clock::time_point now, std::size_t frames) {
+        if (last_frame_at != std::chrono::steady_clock::time_point{} && now != last_frame_at) {
+            interarrival.record(now - last_frame_at);
+        }
+        last_frame_at = now;
+        link_quality.frames_received(now, frames);
+    }
 };
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "points.hpp"
+#include "tool.hpp"
+
+// The tools and which one is selected, as an immutable snapshot.
+// A registry never changes once built. Edits make a modified copy with the with_* / without_* builders, and REMA
+// publishes the copy with an atomic pointer swap. A reader that holds a snapshot can use it, including the cached
+// selected tool, without locks or copies, for as long as it keeps the shared_ptr.
+class ToolRegistry {
+  public:
+    ToolRegistry() : ToolRegistry({}, "", 1.) {
+    }
+
+    // ui_scale is the current session's units per REMA unit, for the precomputed ui offset of the selected tool
+    ToolRegistry(std::map<std::string, Tool> tools, std::string selected_name, double ui_scale)
+        : tools_(std::move(tools)), selected_name_(std::move(selected_name)), ui_scale_(ui_scale) {
+        auto iter = tools_.find(selected_name_);
+        selected_ = iter != tools_.end() ? &iter->second : &no_tool;
+        selected_ui_offset_ = selected_->offset * ui_scale_;
+    }
+
+    ToolRegistry(const ToolRegistry &) = delete; // selected_ points into tools_
+    ToolRegistry &operator=(const ToolRegistry &) = delete;
+
+    const std::map<std::string, Tool> &tools() const {
+        return tools_;
+    }
+
+    // nullptr if there is no such tool
+    const Tool *find(const std::string &name) const {
+        auto iter = tools_.find(name);
+        return iter != tools_.end() ? &iter->second : nullptr;
+    }
+
+    const std::string &selected_name() const {
+        return selected_name_;
+    }
+
+    // A default Tool, with no offset, if the selected one doesn't exist
+    const Tool &selected() const {
+        return *selected_;
+    }
+
+    double ui_scale() const {
+        return ui_scale_;
+    }
+
+    // Same as Session::from_rema_to_ui() with the selected tool, at this registry's ui_scale
+    Point3D to_ui(const Point3D &coords) const {
+        return coords * ui_scale_ - selected_ui_offset_;
+    }
+
+    std::shared_ptr<const ToolRegistry> with_tool(const Tool &tool) const {
+        auto tools = tools_;
+        tools[tool.name] = tool;
+        return std::make_shared<const ToolRegistry>(std::move(tools), selected_name_, ui_scale_);
+    }
+
+    std::shared_ptr<const ToolRegistry> without_tool(const std::string &name) const {
+        auto tools = tools_;
+        tools.erase(name);
+        return std::make_shared<const ToolRegistry>(std::move(tools), selected_name_, ui_scale_);
+    }
+
+    std::shared_ptr<const ToolRegistry> with_selected(const std::string &name) const {
+        return std::make_shared<const ToolRegistry>(tools_, name, ui_scale_);
+    }
+
+    std::shared_ptr<const ToolRegistry> with_ui_scale(double ui_scale) const {
+        return std::make_shared<const ToolRegistry>(tools_, selected_name_, ui_scale);
+    }
+
+  private:
+    inline static const Tool no_tool{};
+
+    const std::map<std::string, Tool> tools_;
+    const std::string selected_name_;
+    const double ui_scale_;
+    const Tool *selected_;
+    Point3D selected_ui_offset_;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Capture of the RTU traffic into a compact timestamped binary file, and its replay.
+// The file starts with an 8 byte magic and holds one record per telemetry frame, command, reply or log line:
+// kind (1 byte), microseconds since the recording started (8 bytes), payload length (4 bytes) and payload, integers
+// little endian. Payloads are kept as they were on the wire: msgpack telemetry, commands and replies in whatever
+// encoding was negotiated, log lines without their terminator.
+namespace traffic {
+
+    enum class Record : uint8_t { TELEMETRY = 1, COMMAND = 2, REPLY = 3, LOG = 4 };
+
+    // Records are queued by the channels and written to disk by a thread of the recorder's own, so a slow disk never
+    // holds up the reactor. If the disk can't keep up, records are dropped once a few MB are waiting.
+    class Recorder {
+      public:
+        ~Recorder() {
+            close();
+        }
+
+        // Starts a new recording, replacing the file. Returns false if it can't be created. open() and close() are
+        // meant for a single thread
+        bool open(const std::filesystem::path &path);
+
+        // Writes out whatever is still queued
+        void close();
+
+        bool is_recording() const {
+            return recording.load(std::memory_order_relaxed);
+        }
+
+        // Thread safe, does nothing unless recording
+        void record(Record kind, std::span<const uint8_t> payload);
+
+        void record(Record kind, std::string_view payload) {
+            record(kind, { reinterpret_cast<const uint8_t *>(payload.data()), payload.size() });
+        }
+
+      private:
+        void write_queued(std::stop_token stop);
+
+        std::atomic<bool> recording = false;
+        std::mutex mtx; // Guards recording changes, queued and dropped. Never held while writing to disk
+        std::condition_variable_any queued_cv;
+        std::vector<char> queued; // Serialized records waiting for the writer, in order
+        uint64_t dropped = 0;
+        std::chrono::steady_clock::time_point started_at;
+        std::ofstream file; // Writer thread only while it runs
+        std::vector<char> file_buffer;
+        std::jthread writer;
+    };
+
+    struct ReplayHandlers {
+        std::function<void(std::span<const uint8_t>)> on_telemetry;
+        std::function<void(std::string &)> on_log;
+        std::function<void(Record, std::span<const uint8_t>)> on_other; // Commands and replies, if wanted
+    };
+
+    struct ReplayStats {
+        uint64_t records = 0;
+        uint64_t telemetry_frames = 0;
+        std::chrono::steady_clock::duration recorded{};
+        std::chrono::steady_clock::duration elapsed{};
+    };
+
+    // Feeds a recording to handlers on the calling thread, keeping the recorded pace sped up by speed, or as fast as
+    // possible if speed is 0, until its end or a stop request. Throws std::runtime_error if the file can't be read or
+    // isn't a recording
+    ReplayStats
+    replay(const std::filesystem::path &path, double speed, const ReplayHandlers &handlers, std::stop_token stop = {});
+
+} // namespace traffic
+
+inline traffic::Recorder traffic_recorder;
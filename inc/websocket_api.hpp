@@ -0,0 +1,26 @@
+#pragma once
+
+#include <restbed>
+
+// /ws: a WebSocket for several concurrent observers and for the joystick.
+//
+// /ws?telemetry=1 streams every telemetry frame as a 112 byte binary message, little endian:
+//    0  u8   kind, 1 = telemetry
+//    1  u8   brakes_mode
+//    2  u16  reserved
+//    4  u32  flags, from bit 0: control_enabled, stall_control, probe_protected, show_target,
+//            on_condition x_y z, joystick_movement x_y z, probe x_y z, stalled x y z,
+//            limits left right up down in out probe
+//    8  u32  sequence, gaps mean frames this observer missed
+//   12  u32  reserved
+//   16  f64  coords x y z, UI units for the selected tool
+//   40  f64  targets x y z
+//   64  f64  aligned_coords x y z
+//   88  f64  aligned_targets x y z
+// A slow observer gets the latest frame and skips the ones in between.
+//
+// Text messages are commands, plain or as a JSON string: a joystick direction as in /REST/move-joystick/{dir},
+// "SS" for a soft stop or "HS" for a hard stop. Each is answered with a text message holding the JSON result, or an
+// error for anything else, which moves nothing.
+// The handshake must be an RFC 6455 version 13 one, and a browser's must come from a page of the proxy itself
+void websocket_api_create_endpoints(restbed::Service &service);
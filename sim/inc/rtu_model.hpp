@@ -0,0 +1,70 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "nlohmann/json.hpp"
+#include "points.hpp"
+#include "telemetry.hpp"
+
+// Stand-in for the REMA controller kinematics.
+// Axes move in straight lines at a constant speed towards their setpoints. A move ends when the target is reached
+// (on_condition), at a travel limit, or early on a random probe touch or stall, as configured.
+class RtuModel {
+  public:
+    struct Params {
+        double xy_speed_normal = 50.;   // units per second
+        double xy_speed_slow = 10.;
+        double z_speed_normal = 20.;
+        double z_speed_slow = 5.;
+        double travel = 2000.;          // every axis moves within [-travel, travel]
+        double probe_probability = 0.;  // per move
+        double stall_probability = 0.;  // per move
+    };
+
+    explicit RtuModel(Params params_);
+
+    // Handles one command object ({"cmd": ..., "pars": ...}) and returns its reply
+    nlohmann::json execute(const nlohmann::json &command);
+
+    // Advances the axes by dt seconds
+    void step(double dt);
+
+    struct telemetry telemetry();
+
+    nlohmann::json temps();
+
+    // Called with every line the controller would log
+    std::function<void(const std::string &)> on_log;
+
+  private:
+    enum class Outcome { REACHED, PROBE, STALL };
+
+    struct Move {
+        bool active = false;
+        Point3D from;
+        Point3D target;
+        double speed = 0.;
+        double length = 0.;             // from origin to target
+        double travelled = 0.;
+        double stop_at = 0.;            // distance at which a probe touch or stall ends the move
+        Outcome outcome = Outcome::REACHED;
+    };
+
+    void start_move(Move &move, bool xy, Point3D target, double speed, bool joystick);
+
+    void end_move(Move &move, bool xy, Outcome outcome);
+
+    void stop_all();
+
+    void log(const std::string &line);
+
+    Params params;
+    std::mutex mtx;
+    std::minstd_rand rng{ std::random_device{}() };
+    struct telemetry state = {};
+    Move xy_move;
+    Move z_move;
+};
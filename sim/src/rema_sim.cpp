@@ -0,0 +1,272 @@
+#include <arpa/inet.h>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "log_pattern.hpp"
+#include "msgpack_frame.hpp"
+#include "nlohmann/json.hpp"
+#include "rtu_model.hpp"
+
+// Local stand-in for the REMA controller, for load tests and development without the hardware.
+// Serves the three RTU endpoints: JSON or msgpack commands on port N, msgpack telemetry and temps on N+1, logs on N+2.
+
+namespace po = boost::program_options;
+
+// Connected clients of a streaming endpoint, anyone whose send fails is dropped
+class Subscribers {
+  public:
+    void add(int fd) {
+        std::lock_guard<std::mutex> lock(mtx);
+        fds.push_back(fd);
+    }
+
+    void send(const void *data, std::size_t size) {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::erase_if(fds, [&](int fd) {
+            if (::send(fd, data, size, MSG_NOSIGNAL) != static_cast<ssize_t>(size)) {
+                SPDLOG_INFO("Client {} gone", fd);
+                ::close(fd);
+                return true;
+            }
+            return false;
+        });
+    }
+
+  private:
+    std::mutex mtx;
+    std::vector<int> fds;
+};
+
+int listen_on(int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Socket creation");
+    }
+    int yes = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(fd, 8) < 0) {
+        ::close(fd);
+        throw std::runtime_error("Unable to listen on port " + std::to_string(port));
+    }
+    SPDLOG_INFO("Listening on PORT: {}", port);
+    return fd;
+}
+
+void accept_loop(int listen_fd, const std::function<void(int)> &on_accept) {
+    while (true) {
+        int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            SPDLOG_ERROR("accept: {}", strerror(errno));
+            return;
+        }
+        int yes = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        on_accept(fd);
+    }
+}
+
+// Size of the JSON array or object at the start of buffer, leading blanks included, 0 if it is incomplete.
+// The proxy doesn't delimit its requests, so their boundaries are found by matching brackets
+std::size_t json_frame_size(const std::string &buffer) {
+    int depth = 0;
+    bool in_string = false;
+    bool escaped = false;
+    for (std::size_t i = 0; i < buffer.size(); ++i) {
+        char c = buffer[i];
+        if (in_string) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                in_string = false;
+            }
+        } else if (c == '"') {
+            in_string = true;
+        } else if (c == '[' || c == '{') {
+            ++depth;
+        } else if ((c == ']' || c == '}') && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Arrays of commands in, one reply object per array out. Connections start as JSON, with null terminated replies.
+// A PROTOCOL command asking for msgpack switches both ways to bare msgpack objects, unless json_only emulates older
+// firmware, which just acknowledges it
+void serve_commands(int fd, RtuModel &model, bool json_only) {
+    std::string rx_buffer;
+    char chunk[4096];
+    bool msgpack = false;
+    while (true) {
+        ssize_t nread = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (nread < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nread <= 0) {
+            break;
+        }
+        rx_buffer.append(chunk, nread);
+
+        while (true) {
+            auto bytes = reinterpret_cast<const uint8_t *>(rx_buffer.data());
+            std::size_t size = msgpack ? msgpack_frame::object_size(bytes, rx_buffer.size()) : json_frame_size(rx_buffer);
+            if (size == msgpack_frame::incomplete) {
+                break;
+            }
+            if (size == msgpack_frame::invalid) {
+                SPDLOG_ERROR("Command stream out of sync, dropping {} bytes", rx_buffer.size());
+                rx_buffer.clear();
+                break;
+            }
+
+            nlohmann::json reply = nlohmann::json::object();
+            bool switch_to_msgpack = false;
+            try {
+                nlohmann::json commands = msgpack ? nlohmann::json::from_msgpack(bytes, bytes + size)
+                                                  : nlohmann::json::parse(rx_buffer.begin(), rx_buffer.begin() + size);
+                for (const auto &command : commands) {
+                    if (command.value("cmd", "") == "PROTOCOL" && !json_only) {
+                        std::string encoding = command["pars"].value("encoding", "json");
+                        reply["PROTOCOL"] = { { "encoding", encoding } };
+                        switch_to_msgpack = encoding == "msgpack";
+                    } else {
+                        reply.update(model.execute(command));
+                    }
+                    if (command.contains("request_id")) {
+                        reply["request_id"] = command["request_id"];
+                    }
+                }
+            } catch (std::exception &e) {
+                reply["error"] = e.what();
+            }
+            rx_buffer.erase(0, size);
+
+            std::string tx_buffer;
+            if (msgpack) {
+                nlohmann::json::to_msgpack(reply, tx_buffer);
+            } else {
+                tx_buffer = reply.dump();
+                tx_buffer.push_back('\0');
+            }
+            if (::send(fd, tx_buffer.data(), tx_buffer.size(), MSG_NOSIGNAL) < 0) {
+                break;
+            }
+            if (switch_to_msgpack) {
+                msgpack = true;
+                SPDLOG_INFO("Command client {} switched to msgpack", fd);
+            }
+        }
+    }
+    SPDLOG_INFO("Command client {} gone", fd);
+    ::close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    spdlog::set_pattern(log_pattern);
+
+    RtuModel::Params params;
+    int port;
+    double rate;
+    bool json_only;
+
+    po::options_description options("REMA simulator");
+    options.add_options()
+        ("help,h", "this help")
+        ("port,p", po::value<int>(&port)->default_value(5020), "command port, telemetry and logs use the next two")
+        ("rate,r", po::value<double>(&rate)->default_value(10.), "telemetry frames per second")
+        ("xy-speed", po::value<double>(&params.xy_speed_normal)->default_value(params.xy_speed_normal), "XY speed, units/s")
+        ("z-speed", po::value<double>(&params.z_speed_normal)->default_value(params.z_speed_normal), "Z speed, units/s")
+        ("travel", po::value<double>(&params.travel)->default_value(params.travel), "axes range is [-travel, travel]")
+        ("probe-probability", po::value<double>(&params.probe_probability)->default_value(0.), "probe touch chance per move")
+        ("stall-probability", po::value<double>(&params.stall_probability)->default_value(0.), "stall chance per move")
+        ("json-only", po::bool_switch(&json_only), "refuse msgpack commands, as older firmware does");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+    } catch (std::exception &e) {
+        SPDLOG_ERROR(e.what());
+        return 1;
+    }
+    if (vm.count("help") || rate <= 0.) {
+        std::cout << options << "\n";
+        return vm.count("help") ? 0 : 1;
+    }
+    params.xy_speed_slow = params.xy_speed_normal / 5;
+    params.z_speed_slow = params.z_speed_normal / 4;
+
+    RtuModel model(params);
+    Subscribers telemetry_clients;
+    Subscribers logs_clients;
+
+    model.on_log = [&](const std::string &line) {
+        SPDLOG_INFO("RTU: {}", line);
+        logs_clients.send(line.c_str(), line.size() + 1);
+    };
+
+    int command_fd, telemetry_fd, logs_fd;
+    try {
+        command_fd = listen_on(port);
+        telemetry_fd = listen_on(port + 1);
+        logs_fd = listen_on(port + 2);
+    } catch (std::exception &e) {
+        SPDLOG_ERROR(e.what());
+        return 1;
+    }
+
+    std::jthread command_thread([&] {
+        accept_loop(command_fd, [&](int fd) { std::thread(serve_commands, fd, std::ref(model), json_only).detach(); });
+    });
+    std::jthread telemetry_thread([&] { accept_loop(telemetry_fd, [&](int fd) { telemetry_clients.add(fd); }); });
+    std::jthread logs_thread([&] { accept_loop(logs_fd, [&](int fd) { logs_clients.add(fd); }); });
+
+    SPDLOG_INFO("Simulating REMA at {} telemetry frames per second", rate);
+
+    // Fixed rate loop, sleeping until an absolute deadline so the frame rate doesn't drift with the work done
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1. / rate));
+    auto next_frame = std::chrono::steady_clock::now();
+    auto next_temps = next_frame;
+    while (true) {
+        model.step(std::chrono::duration<double>(period).count());
+
+        nlohmann::json frame;
+        frame["telemetry"] = model.telemetry();
+        std::vector<uint8_t> bytes = nlohmann::json::to_msgpack(frame);
+        telemetry_clients.send(bytes.data(), bytes.size());
+
+        if (next_frame >= next_temps) {
+            nlohmann::json temps;
+            temps["temps"] = model.temps();
+            bytes = nlohmann::json::to_msgpack(temps);
+            telemetry_clients.send(bytes.data(), bytes.size());
+            next_temps += std::chrono::seconds(1);
+        }
+
+        next_frame += period;
+        std::this_thread::sleep_until(next_frame);
+    }
+}
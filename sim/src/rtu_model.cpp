@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "rtu_model.hpp"
+
+namespace {
+    double distance(const Point3D &a, const Point3D &b) {
+        Point3D d = b - a;
+        return std::sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+    }
+} // namespace
+
+RtuModel::RtuModel(Params params_) : params(params_) {
+    state.control_enabled = true;
+    state.stall_control = true;
+}
+
+nlohmann::json RtuModel::execute(const nlohmann::json &command) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string cmd = command.value("cmd", "");
+    nlohmann::json pars = command.value("pars", nlohmann::json::object());
+    nlohmann::json res;
+    res["ACK"] = true;
+
+    if (cmd == "MOVE_CLOSED_LOOP" || cmd == "MOVE_JOYSTICK" || cmd == "MOVE_INCREMENTAL") {
+        std::string axes = pars.value("axes", "");
+        bool slow = pars.value("speed", "NORMAL") == "SLOW";
+        Point3D target = state.coords;
+
+        if (axes == "XY") {
+            if (cmd == "MOVE_INCREMENTAL") {
+                target.x += pars.value("first_axis_delta", 0.);
+                target.y += pars.value("second_axis_delta", 0.);
+            } else {
+                target.x = pars.value("first_axis_setpoint", target.x);
+                target.y = pars.value("second_axis_setpoint", target.y);
+            }
+            start_move(xy_move, true, target, slow ? params.xy_speed_slow : params.xy_speed_normal,
+                       cmd == "MOVE_JOYSTICK");
+        } else if (axes == "Z") {
+            if (cmd == "MOVE_INCREMENTAL") {
+                target.z += pars.value("first_axis_delta", 0.);
+            } else {
+                target.z = pars.value("first_axis_setpoint", target.z);
+            }
+            start_move(z_move, false, target, slow ? params.z_speed_slow : params.z_speed_normal,
+                       cmd == "MOVE_JOYSTICK");
+        } else {
+            res = { { "error", "INVALID AXES" } };
+        }
+    } else if (cmd == "AXES_HARD_STOP_ALL" || cmd == "AXES_SOFT_STOP_ALL") {
+        stop_all();
+    } else if (cmd == "SET_COORDS") {
+        state.coords.x = pars.value("position_X", state.coords.x);
+        state.coords.y = pars.value("position_Y", state.coords.y);
+        state.coords.z = pars.value("position_Z", state.coords.z);
+        state.targets = state.coords;
+    } else if (cmd == "TOUCH_PROBE") {
+        log("Touch probe " + pars.value("position", std::string("?")));
+    }
+    // Settings commands (AXES_SETTINGS, TOUCH_PROBE_SETTINGS, ...) have nothing to simulate and are just acknowledged
+
+    return { { cmd, res } };
+}
+
+void RtuModel::start_move(Move &move, bool xy, Point3D target, double speed, bool joystick) {
+    target.x = std::clamp(target.x, -params.travel, params.travel);
+    target.y = std::clamp(target.y, -params.travel, params.travel);
+    target.z = std::clamp(target.z, -params.travel, params.travel);
+
+    move.active = true;
+    move.from = state.coords;
+    move.target = target;
+    move.speed = speed;
+    move.length = distance(move.from, move.target);
+    move.travelled = 0.;
+    move.outcome = Outcome::REACHED;
+    move.stop_at = move.length;
+
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    if (uniform(rng) < params.probe_probability) {
+        move.outcome = Outcome::PROBE;
+        move.stop_at = move.length * uniform(rng);
+    } else if (uniform(rng) < params.stall_probability) {
+        move.outcome = Outcome::STALL;
+        move.stop_at = move.length * uniform(rng);
+    }
+
+    // Flags belong to the last move, the proxy polls them to tell when this one is over
+    if (xy) {
+        state.targets.x = target.x;
+        state.targets.y = target.y;
+        state.on_condition.x_y = false;
+        state.probe.x_y = false;
+        state.joystick_movement.x_y = joystick;
+        state.stalled.x = state.stalled.y = false;
+        state.limits.left = state.limits.right = state.limits.up = state.limits.down = false;
+    } else {
+        state.targets.z = target.z;
+        state.on_condition.z = false;
+        state.probe.z = false;
+        state.joystick_movement.z = joystick;
+        state.stalled.z = false;
+        state.limits.in = state.limits.out = false;
+    }
+    state.limits.probe = false;
+}
+
+void RtuModel::end_move(Move &move, bool xy, Outcome outcome) {
+    move.active = false;
+    switch (outcome) {
+    case Outcome::REACHED:
+        if (xy) {
+            state.on_condition.x_y = true;
+            state.limits.left = state.coords.x <= -params.travel;
+            state.limits.right = state.coords.x >= params.travel;
+            state.limits.down = state.coords.y <= -params.travel;
+            state.limits.up = state.coords.y >= params.travel;
+        } else {
+            state.on_condition.z = true;
+            state.limits.out = state.coords.z <= -params.travel;
+            state.limits.in = state.coords.z >= params.travel;
+        }
+        break;
+    case Outcome::PROBE:
+        (xy ? state.probe.x_y : state.probe.z) = true;
+        state.limits.probe = true;
+        log(std::string("Probe touch on ") + (xy ? "XY" : "Z"));
+        break;
+    case Outcome::STALL:
+        if (xy) {
+            state.stalled.x = state.stalled.y = true;
+        } else {
+            state.stalled.z = true;
+        }
+        log(std::string("Stall on ") + (xy ? "XY" : "Z"));
+        break;
+    }
+    if (xy) {
+        state.joystick_movement.x_y = false;
+    } else {
+        state.joystick_movement.z = false;
+    }
+}
+
+void RtuModel::stop_all() {
+    if (xy_move.active) {
+        xy_move.active = false;
+        state.joystick_movement.x_y = false;
+        state.targets.x = state.coords.x;
+        state.targets.y = state.coords.y;
+    }
+    if (z_move.active) {
+        z_move.active = false;
+        state.joystick_movement.z = false;
+        state.targets.z = state.coords.z;
+    }
+}
+
+void RtuModel::step(double dt) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (bool xy : { true, false }) {
+        Move &move = xy ? xy_move : z_move;
+        if (!move.active) {
+            continue;
+        }
+
+        move.travelled = std::min(move.travelled + move.speed * dt, move.stop_at);
+        Point3D position = move.length > 0.
+                               ? move.from + (move.target - move.from) * (move.travelled / move.length)
+                               : move.target;
+        if (xy) {
+            state.coords.x = position.x;
+            state.coords.y = position.y;
+        } else {
+            state.coords.z = position.z;
+        }
+
+        if (move.travelled >= move.stop_at) {
+            end_move(move, xy, move.outcome);
+        }
+    }
+}
+
+struct telemetry RtuModel::telemetry() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return state;
+}
+
+nlohmann::json RtuModel::temps() {
+    // Tenths of a degree, as the controller reports them
+    std::normal_distribution<double> noise(0., 2.);
+    std::lock_guard<std::mutex> lock(mtx);
+    return { { "x", std::round(250. + noise(rng)) },
+             { "y", std::round(255. + noise(rng)) },
+             { "z", std::round(260. + noise(rng)) } };
+}
+
+void RtuModel::log(const std::string &line) {
+    if (on_log) {
+        on_log(line);
+    }
+}
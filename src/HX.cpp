@@ -125,6 +125,7 @@ void HX::generate_svg() {
     std::ostringstream stream;
     stream << document;
     tubesheet_svg = stream.str();
+    tubesheet_svg_content.store(CachedContent::make(tubesheet_svg, "image/svg+xml"));
 
     // Write the SVG document to a file
     std::filesystem::path svg_path = hxs_path / hx / "tubesheet.svg";
@@ -0,0 +1,73 @@
+#include <brotli/encode.h>
+#include <openssl/sha.h>
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+#include "cached_content.hpp"
+
+namespace {
+    // 11 takes seconds for wwwroot and gains little over 9
+    constexpr int brotli_quality = 9;
+
+    // JPEG and PNG are compressed already
+    bool is_compressible(const std::string &content_type) {
+        return content_type != "image/jpg" && content_type != "image/png";
+    }
+
+    std::string hex_hash(const std::string &body) {
+        unsigned char digest[SHA256_DIGEST_LENGTH];
+        SHA256(reinterpret_cast<const unsigned char *>(body.data()), body.size(), digest);
+        std::string res;
+        for (std::size_t i = 0; i < 16; ++i) {
+            res += fmt::format("{:02x}", digest[i]);
+        }
+        return res;
+    }
+
+    std::string gzip_compress(const std::string &body) {
+        z_stream zs{};
+        if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) { // 16: gzip wrapper
+            return {};
+        }
+        std::string res(deflateBound(&zs, body.size()), '\0');
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(body.data()));
+        zs.avail_in = static_cast<uInt>(body.size());
+        zs.next_out = reinterpret_cast<Bytef *>(res.data());
+        zs.avail_out = static_cast<uInt>(res.size());
+        bool done = deflate(&zs, Z_FINISH) == Z_STREAM_END;
+        res.resize(zs.total_out);
+        deflateEnd(&zs);
+        return done ? res : std::string();
+    }
+
+    std::string brotli_compress(const std::string &body) {
+        std::size_t size = BrotliEncoderMaxCompressedSize(body.size());
+        if (size == 0) {
+            return {};
+        }
+        std::string res(size, '\0');
+        if (!BrotliEncoderCompress(brotli_quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, body.size(),
+                                   reinterpret_cast<const uint8_t *>(body.data()), &size,
+                                   reinterpret_cast<uint8_t *>(res.data()))) {
+            return {};
+        }
+        res.resize(size);
+        return res;
+    }
+} // namespace
+
+std::shared_ptr<const CachedContent> CachedContent::make(std::string body, std::string content_type) {
+    auto res = std::make_shared<CachedContent>();
+    res->hash = hex_hash(body);
+    if (is_compressible(content_type)) {
+        if (auto compressed = gzip_compress(body); compressed.size() < body.size()) {
+            res->gzip = std::move(compressed);
+        }
+        if (auto compressed = brotli_compress(body); compressed.size() < body.size()) {
+            res->brotli = std::move(compressed);
+        }
+    }
+    res->content_type = std::move(content_type);
+    res->identity = std::move(body);
+    return res;
+}
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#include "connection_supervisor.hpp"
+#include "magic_enum/magic_enum.hpp"
+#include "metrics.hpp"
+
+ConnectionSupervisor::ConnectionSupervisor(Reactor &reactor_) : reactor(reactor_) {
+}
+
+void ConnectionSupervisor::add_channel(
+    const std::string &name,
+    NetClient &client,
+    int port_offset,
+    bool required,
+    std::function<void()> on_up) {
+    auto channel = std::make_unique<Channel>();
+    channel->name = name;
+    channel->client = &client;
+    channel->port_offset = port_offset;
+    channel->required = required;
+    channel->on_up = on_up;
+
+    Channel *ch = channel.get();
+    client.set_on_connection_lost([this, ch] {
+        // Teardowns caused by our own reconnects arrive while CONNECTING and are not failures
+        if (ch->state == LinkState::CONNECTED) {
+            SPDLOG_WARN("{} connection lost", ch->name);
+            ++metrics.connections_lost[ch->name];
+            schedule_retry(*ch);
+        }
+    });
+    channels.push_back(std::move(channel));
+}
+
+void ConnectionSupervisor::connect(const std::string &host_, int base_port_) {
+    reactor.post([this, host_, base_port_] {
+        host = host_;
+        base_port = base_port_;
+        for (auto &channel : channels) {
+            channel->attempt = 0;
+            try_connect(*channel);
+        }
+    });
+}
+
+void ConnectionSupervisor::try_connect(Channel &channel) {
+    uint64_t generation = ++channel.generation;
+    set_state(channel, LinkState::CONNECTING);
+
+    channel.client->connect_async(host, base_port + channel.port_offset, [this, &channel, generation](int result) {
+        if (generation != channel.generation) {
+            return;
+        }
+        if (result < 0) {
+            schedule_retry(channel);
+            return;
+        }
+        channel.attempt = 0;
+        set_state(channel, LinkState::CONNECTED);
+        if (channel.on_up) {
+            worker.send(channel.on_up);
+        }
+    });
+
+    reactor.post_after(connect_timeout, [this, &channel, generation] {
+        if (generation == channel.generation && channel.state == LinkState::CONNECTING) {
+            SPDLOG_WARN("{} connection timed out", channel.name);
+            channel.client->close();
+            schedule_retry(channel);
+        }
+    });
+}
+
+void ConnectionSupervisor::schedule_retry(Channel &channel) {
+    uint64_t generation = ++channel.generation;
+    set_state(channel, LinkState::BACKOFF);
+
+    // Full exponential delay capped at backoff_max, then drawn from its upper half so that the channels (and several
+    // proxies) don't hammer the RTU in lockstep
+    auto delay = backoff_base * (1LL << std::min(channel.attempt, 16));
+    delay = std::min<std::chrono::milliseconds>(delay, backoff_max);
+    std::uniform_int_distribution<long long> jitter(delay.count() / 2, delay.count());
+    delay = std::chrono::milliseconds(jitter(rng));
+    ++channel.attempt;
+
+    SPDLOG_INFO("Retrying {} connection in {} ms", channel.name, delay.count());
+    reactor.post_after(delay, [this, &channel, generation] {
+        if (generation == channel.generation) {
+            ++metrics.reconnects[channel.name];
+            try_connect(channel);
+        }
+    });
+}
+
+void ConnectionSupervisor::set_state(Channel &channel, LinkState state) {
+    if (channel.state.exchange(state) != state) {
+        ++state_version;
+        if (on_change) {
+            on_change();
+        }
+    }
+}
+
+LinkState ConnectionSupervisor::state() const {
+    LinkState res = LinkState::CONNECTED;
+    for (const auto &channel : channels) {
+        if (channel->required) {
+            res = std::min(res, channel->state.load());
+        }
+    }
+    return res;
+}
+
+nlohmann::json ConnectionSupervisor::status() const {
+    nlohmann::json res;
+    res["state"] = magic_enum::enum_name(state());
+    for (const auto &channel : channels) {
+        res["channels"][channel->name] = magic_enum::enum_name(channel->state.load());
+    }
+    return res;
+}
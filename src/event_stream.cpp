@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <spdlog/spdlog.h>
+#include <string>
+
+#include "event_stream.hpp"
+#include "metrics.hpp"
+#include "session.hpp"
+
+namespace {
+    const std::multimap<std::string, std::string> sse_headers{
+        { "Connection", "keep-alive" },
+        { "Cache-Control", "no-cache" },
+        { "Content-Type", "text/event-stream" },
+        { "Access-Control-Allow-Origin", "*" } // Only required for demo purposes.
+    };
+
+    // Everything but the coordinates
+    bool same_state(const struct telemetry &a, const struct telemetry &b) {
+        return !(a.targets != b.targets) && a.on_condition == b.on_condition &&
+               a.joystick_movement == b.joystick_movement && a.probe == b.probe && a.stalled == b.stalled &&
+               a.limits == b.limits && a.control_enabled == b.control_enabled && a.stall_control == b.stall_control &&
+               a.brakes_mode == b.brakes_mode && a.probe_protected == b.probe_protected;
+    }
+
+    double max_axis_delta(const Point3D &a, const Point3D &b) {
+        return std::max({ std::fabs(a.x - b.x), std::fabs(a.y - b.y), std::fabs(a.z - b.z) });
+    }
+
+    nlohmann::json telemetry_json(const struct telemetry &ui_telemetry, bool show_target) {
+        nlohmann::json res = ui_telemetry;
+        res["aligned_coords"] = current_session.transform_point_if_aligned(ui_telemetry.coords, true);
+        res["aligned_targets"] = current_session.transform_point_if_aligned(ui_telemetry.targets, true);
+        res["show_target"] = show_target;
+        return res;
+    }
+
+    // Projects the coordinates to now with the speed between the last two frames received. Never further ahead than
+    // the time between those frames, so that a stalled stream doesn't make the axes run away on screen
+    Point3D extrapolated_coords(const struct telemetry &ui_telemetry, std::chrono::steady_clock::time_point now) {
+        auto last = rema.telemetry_history.latest(2);
+        if (last.size() < 2) {
+            return ui_telemetry.coords;
+        }
+        auto frame_period = last[1].time - last[0].time;
+        auto ahead = std::min(now - last[1].time, frame_period);
+        if (frame_period <= std::chrono::steady_clock::duration::zero() || ahead <= std::chrono::steady_clock::duration::zero()) {
+            return ui_telemetry.coords;
+        }
+
+        auto tools = rema.tool_registry();
+        Point3D velocity = (tools->to_ui(last[1].telemetry.coords) - tools->to_ui(last[0].telemetry.coords)) /
+                           std::chrono::duration<double>(frame_period).count();
+        return ui_telemetry.coords + velocity * std::chrono::duration<double>(ahead).count();
+    }
+
+    // The id lets the client resume after the last line it got
+    std::shared_ptr<const std::string> logs_message(const RtuLog::Lines &logs) {
+        nlohmann::json res;
+        res["LOGS"] = logs.lines;
+        return std::make_shared<const std::string>("id: " + std::to_string(logs.next) + "\ndata: " + res.dump() + "\n\n");
+    }
+
+    void register_event_source_handler(const std::shared_ptr<restbed::Session> &session) {
+        auto policy = TelemetryPolicy::from_request(*session->get_request());
+        auto topics = EventStream::topics_from_request(*session->get_request());
+        auto logs_from = EventStream::logs_from_request(*session->get_request());
+        session->yield(restbed::OK, sse_headers, [policy, topics, logs_from](const std::shared_ptr<restbed::Session> &rest_session_ptr) {
+            event_stream.add_client(rest_session_ptr, policy, topics, logs_from);
+        });
+    }
+} // namespace
+
+TelemetryPolicy TelemetryPolicy::from_request(const restbed::Request &request) {
+    TelemetryPolicy policy;
+    try {
+        if (auto fps = request.get_query_parameter("fps", ""); !fps.empty()) {
+            double max_fps = 1000. / EventStream::min_frame_interval.count();
+            policy.fps = std::clamp(std::stod(fps), 0.1, max_fps);
+        }
+        if (auto min_delta = request.get_query_parameter("min_delta", ""); !min_delta.empty()) {
+            policy.min_delta = std::max(std::stod(min_delta), 0.);
+        }
+        if (auto max_interval = request.get_query_parameter("max_interval_ms", ""); !max_interval.empty()) {
+            policy.max_interval = std::max(std::chrono::milliseconds(std::stol(max_interval)), EventStream::min_frame_interval);
+        }
+        auto extrapolate = request.get_query_parameter("extrapolate", "");
+        policy.extrapolate = extrapolate == "1" || extrapolate == "true";
+    } catch (std::exception &e) {
+        SPDLOG_WARN("Invalid SSE telemetry policy, using defaults for the rest: {}", e.what());
+    }
+    return policy;
+}
+
+uint32_t EventStream::topics_from_request(const restbed::Request &request) {
+    static const std::map<std::string, Topic> names{ { "telemetry", TELEMETRY }, { "temps", TEMPS },
+                                                     { "connection", CONNECTION }, { "session", SESSION },
+                                                     { "logs", LOGS },           { "plan", PLAN } };
+    std::string list = request.get_query_parameter("topics", "");
+    if (list.empty()) {
+        return default_topics;
+    }
+
+    uint32_t res = 0;
+    std::istringstream names_stream(list);
+    for (std::string name; std::getline(names_stream, name, ',');) {
+        if (auto iter = names.find(name); iter != names.end()) {
+            res |= iter->second;
+        } else if (!name.empty()) {
+            SPDLOG_WARN("Unknown SSE topic: {}", name);
+        }
+    }
+    return res;
+}
+
+std::optional<uint64_t> EventStream::logs_from_request(const restbed::Request &request) {
+    std::string from = request.get_header("Last-Event-ID", "");
+    if (from.empty()) {
+        from = request.get_query_parameter("logs_from", "");
+    }
+    try {
+        if (!from.empty()) {
+            return std::stoull(from);
+        }
+    } catch (std::exception &) {
+        SPDLOG_WARN("Invalid SSE logs position: {}", from);
+    }
+    return std::nullopt;
+}
+
+void EventStream::publish_tube_executed(const std::string &plan, const std::string &tube_id, bool executed) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mtx);
+        pending_tubes.push_back({ { "plan", plan }, { "tube_id", tube_id }, { "executed", executed } });
+    }
+    publish(PLAN);
+}
+
+void EventStream::add_client(const std::shared_ptr<restbed::Session> &session, const TelemetryPolicy &policy, uint32_t topics,
+                             std::optional<uint64_t> logs_from) {
+    auto client = std::make_shared<Client>();
+    client->session = session;
+    client->policy = policy;
+    client->topics = topics;
+
+    Message first;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (topics & CONNECTION) {
+            nlohmann::json res;
+            res["CONNECTION"] = rema.supervisor.status();
+            enqueue(*client, std::make_shared<const std::string>("data: " + nlohmann::to_string(res) + "\n\n"), false);
+        }
+        if (topics & LOGS) {
+            // The lines the broadcaster already sent, the rest come with the next broadcast
+            client->logs_next = std::max(logs_from.value_or(logs_sent), logs_sent);
+            if (logs_from && *logs_from < logs_sent) {
+                if (auto missed = rema.rtu_log.since(*logs_from, logs_sent); !missed.lines.empty()) {
+                    enqueue(*client, logs_message(missed), false);
+                }
+            }
+        }
+        first = next_write(*client);
+        clients.push_back(client);
+    }
+    write(client, first);
+    if (topics & TELEMETRY) {
+        publish(TELEMETRY); // Its first frame
+    }
+}
+
+void EventStream::add_listener(std::function<void(uint32_t topics)> listener) {
+    std::lock_guard<std::mutex> lock(mtx);
+    listeners.push_back(std::move(listener));
+}
+
+void EventStream::start() {
+    broadcaster = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+void EventStream::run(std::stop_token stop) {
+    auto is_pending = [this] { return pending.load(std::memory_order_acquire) != 0; };
+    while (!stop.stop_requested()) {
+        bool published;
+        {
+            std::unique_lock<std::mutex> lock(wake_mtx);
+            published = next_deadline == time_point::max() ? wake.wait(lock, stop, is_pending)
+                                                           : wake.wait_until(lock, stop, next_deadline, is_pending);
+        }
+        if (stop.stop_requested()) {
+            return;
+        }
+        if (published) {
+            std::this_thread::sleep_for(coalescing_window);
+        }
+        broadcast(pending.exchange(0, std::memory_order_acquire));
+    }
+}
+
+bool EventStream::telemetry_changed(const Client &client, const struct telemetry &candidate, bool show_target) const {
+    return show_target != client.last_show_target || !same_state(candidate, client.last_sent) ||
+           max_axis_delta(candidate.coords, client.last_sent.coords) >= client.policy.min_delta;
+}
+
+bool EventStream::enqueue(Client &client, const Message &message, bool telemetry) {
+    if (telemetry) {
+        if (client.queued_telemetry) {
+            static std::atomic<uint64_t> &frames_dropped = metrics.frames_dropped["sse"];
+            ++frames_dropped;
+        }
+        client.queued_telemetry = message;
+    } else {
+        if (client.queued_events.size() >= max_queued_events) {
+            return false;
+        }
+        client.queued_events.push_back(message);
+    }
+    return true;
+}
+
+EventStream::Message EventStream::next_write(Client &client) {
+    if (client.writing || client.evicted) {
+        return nullptr;
+    }
+    Message message;
+    if (!client.queued_events.empty()) {
+        message = std::move(client.queued_events.front());
+        client.queued_events.pop_front();
+    } else {
+        message = std::move(client.queued_telemetry);
+        client.queued_telemetry = nullptr;
+    }
+    if (message) {
+        client.writing = true;
+        client.writing_since = std::chrono::steady_clock::now();
+    }
+    return message;
+}
+
+// Chains itself until the client's queue is empty. Restbed copies the message into its own write buffer
+void EventStream::write(const std::shared_ptr<Client> &client, Message message) {
+    if (!message) {
+        return;
+    }
+    client->session->yield(*message, [this, client](const std::shared_ptr<restbed::Session> &) {
+        Message next;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            client->writing = false;
+            next = next_write(*client);
+        }
+        write(client, next);
+    });
+}
+
+void EventStream::evict(Client &client, const char *reason) {
+    if (!client.evicted) {
+        client.evicted = true;
+        ++metrics.sse_clients_evicted[reason];
+        SPDLOG_WARN("Disconnecting a slow SSE client ({})", reason);
+    }
+}
+
+void EventStream::broadcast(uint32_t topics) {
+    // Saved whether or not anyone is listening
+    bool session_saved = false;
+    if ((topics & SESSION) && current_session.is_loaded && current_session.is_changed) {
+        current_session.save_to_disk();
+        current_session.is_changed = false;
+        session_saved = true;
+    }
+
+    nlohmann::json tubes = nlohmann::json::array();
+    if (topics & PLAN) {
+        std::lock_guard<std::mutex> lock(pending_mtx);
+        std::swap(tubes, pending_tubes);
+    }
+
+    std::vector<std::pair<std::shared_ptr<Client>, Message>> writes;
+    std::vector<std::shared_ptr<restbed::Session>> evicted;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto now = std::chrono::steady_clock::now();
+        next_deadline = time_point::max();
+        for (const auto &listener : listeners) {
+            listener(topics);
+        }
+
+        // One message per topic, only if someone subscribed to it
+        uint32_t subscribed = 0;
+        for (const auto &client : clients) {
+            subscribed |= client->topics;
+        }
+        std::vector<std::pair<Topic, Message>> topic_messages;
+        auto add_message = [&](Topic topic, const char *key, const nlohmann::json &value) {
+            if (subscribed & topic) {
+                nlohmann::json res;
+                res[key] = value;
+                topic_messages.emplace_back(topic, std::make_shared<const std::string>("data: " + res.dump() + "\n\n"));
+            }
+        };
+        if (topics & TEMPS) {
+            add_message(TEMPS, "TEMP_INFO", rema.temps.load());
+        }
+        if (topics & CONNECTION) {
+            add_message(CONNECTION, "CONNECTION", rema.supervisor.status());
+        }
+        if (session_saved) {
+            add_message(SESSION, "SESSION_MSG", "Session Saved");
+        }
+        if (!tubes.empty() && (subscribed & PLAN)) {
+            add_message(PLAN,
+                        "PLAN_PROGRESS",
+                        { { "tubes", tubes },
+                          { "total_tubes_in_plans", current_session.total_tubes_in_plans() },
+                          { "total_tubes_executed", current_session.total_tubes_executed() } });
+        }
+
+        // The new log lines, in a message shared by the clients that need all of them. A client that asked to start
+        // after some of them gets a message of its own
+        RtuLog::Lines logs;
+        if (topics & LOGS) {
+            logs = rema.rtu_log.since(logs_sent);
+            logs_sent = logs.next;
+        }
+        uint64_t logs_first = logs.next - logs.lines.size();
+        Message logs_shared;
+        auto logs_for = [&](Client &client) {
+            Message message;
+            if (client.logs_next <= logs_first) {
+                if (!logs_shared) {
+                    logs_shared = logs_message(logs);
+                }
+                message = logs_shared;
+            } else {
+                message = logs_message(rema.rtu_log.since(client.logs_next, logs.next));
+            }
+            client.logs_next = logs.next;
+            return message;
+        };
+
+        // Telemetry, each variant built and serialized at most once and only if some client needs it
+        struct telemetry ui_telemetry = rema.ui_telemetry.load();
+        auto received_at = rema.ui_telemetry_received_at.load();
+        bool show_target = rema.is_sequence_in_progress;
+        std::optional<struct telemetry> extrapolated;
+        Message telemetry_message;
+        Message extrapolated_message;
+
+        for (auto &client_ptr : clients) {
+            Client &client = *client_ptr;
+            if (client.session->is_closed()) {
+                client.evicted = true;
+                continue;
+            }
+            if (client.writing && now - client.writing_since >= stall_timeout) {
+                evict(client, "stalled");
+                continue;
+            }
+
+            bool overflow = false;
+            for (const auto &[topic, message] : topic_messages) {
+                if ((client.topics & topic) && !enqueue(client, message, false)) {
+                    overflow = true;
+                    break;
+                }
+            }
+            if (!overflow && (client.topics & LOGS) && client.logs_next < logs.next) {
+                overflow = !enqueue(client, logs_for(client), false);
+            }
+            if (overflow) {
+                evict(client, "overflow");
+                continue;
+            }
+
+            client.next_at = time_point::max();
+            if (client.topics & TELEMETRY) {
+                if (client.policy.extrapolate && !extrapolated) {
+                    extrapolated = ui_telemetry;
+                    extrapolated->coords = extrapolated_coords(ui_telemetry, now);
+                }
+                const struct telemetry &candidate = client.policy.extrapolate ? *extrapolated : ui_telemetry;
+                auto frame_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1. / client.policy.fps));
+                auto since_last = now - client.last_sent_at;
+                bool changed = telemetry_changed(client, candidate, show_target);
+                bool due = !client.sent_any || since_last >= client.policy.max_interval ||
+                           (changed && since_last >= frame_interval);
+
+                if (due) {
+                    Message &message = client.policy.extrapolate ? extrapolated_message : telemetry_message;
+                    try {
+                        if (!message) {
+                            message = std::make_shared<const std::string>(
+                                "data: {\"TELEMETRY\":" + telemetry_json(candidate, show_target).dump() + "}\n\n");
+                        }
+                        enqueue(client, message, true);
+                    } catch (std::exception &e) {
+                        SPDLOG_ERROR("Telemetry connection lost... {}", e.what());
+                    }
+                    client.last_sent = candidate;
+                    client.last_show_target = show_target;
+                    client.last_sent_at = now;
+                    client.sent_any = true;
+                }
+
+                // A rate limited change, or coordinates still being projected forward, need another look a frame later
+                client.next_at = client.last_sent_at + client.policy.max_interval;
+                bool projecting = due && max_axis_delta(candidate.coords, ui_telemetry.coords) > 0.;
+                if ((changed && !due) || projecting) {
+                    client.next_at = std::min(client.next_at, client.last_sent_at + frame_interval);
+                }
+            }
+
+            if (Message next = next_write(client)) {
+                writes.emplace_back(client_ptr, std::move(next));
+            }
+            if (client.writing) {
+                client.next_at = std::min(client.next_at, client.writing_since + stall_timeout);
+            }
+            next_deadline = std::min(next_deadline, client.next_at);
+        }
+
+        for (const auto &client : clients) {
+            if (client->evicted) {
+                evicted.push_back(client->session);
+            }
+        }
+        std::erase_if(clients, [](const std::shared_ptr<Client> &client) { return client->evicted; });
+
+        // Each frame counts once, however many clients got it or how often it was repeated
+        bool published = telemetry_message || extrapolated_message;
+        if (published && received_at != last_published_received_at) {
+            rema.telemetry_client.link_quality.frame_published(received_at, std::chrono::steady_clock::now());
+            last_published_received_at = received_at;
+        }
+    }
+
+    for (const auto &session : evicted) {
+        if (!session->is_closed()) {
+            session->close();
+        }
+    }
+    for (auto &[client, message] : writes) {
+        write(client, std::move(message));
+    }
+}
+
+void event_stream_create_endpoints(restbed::Service &service) {
+    auto resource_server_side_events = std::make_shared<restbed::Resource>();
+    resource_server_side_events->set_path("/sse");
+    resource_server_side_events->set_method_handler("GET", register_event_source_handler);
+    service.publish(resource_server_side_events);
+
+    event_stream.start();
+}
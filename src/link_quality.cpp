@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+
+#include "link_quality.hpp"
+#include "metrics.hpp"
+
+namespace {
+    double seconds(std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+} // namespace
+
+void LinkQuality::connected(bool kernel_timestamps_) {
+    std::lock_guard<std::mutex> lock(mtx);
+    arrivals.clear();
+    gaps.clear();
+    publish_latencies.clear();
+    usual_interarrival_s = 0.;
+    gaps_total = 0;
+    ++connection;
+    kernel_timestamps = kernel_timestamps_;
+}
+
+void LinkQuality::frames_received(time_point received_at, std::size_t frames) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!arrivals.empty() && arrivals.back().at == received_at) {
+        arrivals.back().frames += frames; // The rest of the same arrival
+        return;
+    }
+    if (!arrivals.empty()) {
+        double interarrival_s = seconds(received_at - arrivals.back().at);
+        if (usual_interarrival_s > 0. && interarrival_s > gap_factor * usual_interarrival_s) {
+            gaps.push_back(received_at);
+            ++gaps_total;
+            ++metrics.telemetry_gaps["telemetry"];
+        } else {
+            usual_interarrival_s = usual_interarrival_s > 0. ? usual_interarrival_s + (interarrival_s - usual_interarrival_s) / 16.
+                                                             : interarrival_s;
+        }
+    }
+    arrivals.push_back({ received_at, frames });
+    if (arrivals.size() > max_frames_) {
+        arrivals.pop_front();
+    }
+    expire(received_at);
+}
+
+void LinkQuality::frame_published(time_point received_at, time_point published_at) {
+    auto latency = published_at - received_at;
+    metrics.telemetry_publish_latency["sse"].record(latency);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    publish_latencies.emplace_back(published_at, latency);
+    if (publish_latencies.size() > max_frames_) {
+        publish_latencies.pop_front();
+    }
+    expire(published_at);
+}
+
+LinkQuality::Snapshot LinkQuality::snapshot(time_point now) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    expire(now);
+
+    Snapshot res;
+    res.connection = connection;
+    res.kernel_timestamps = kernel_timestamps;
+    for (const auto &arrival : arrivals) {
+        res.frames += arrival.frames;
+    }
+    res.arrivals = arrivals.size();
+    res.gaps = gaps.size();
+    res.gaps_total = gaps_total;
+
+    if (arrivals.size() > 1) {
+        std::size_t intervals = arrivals.size() - 1;
+        double span_s = seconds(arrivals.back().at - arrivals.front().at);
+        double mean_s = span_s / intervals;
+        double sum_sq = 0.;
+        for (std::size_t i = 1; i < arrivals.size(); ++i) {
+            double deviation = seconds(arrivals[i].at - arrivals[i - 1].at) - mean_s;
+            sum_sq += deviation * deviation;
+        }
+        res.fps = span_s > 0. ? (res.frames - arrivals.front().frames) / span_s : 0.; // Those that came after the first
+        res.interarrival_ms = mean_s * 1e3;
+        res.jitter_ms = std::sqrt(sum_sq / intervals) * 1e3;
+    }
+
+    if (!publish_latencies.empty()) {
+        double sum_s = 0.;
+        double max_s = 0.;
+        for (const auto &[published_at, latency] : publish_latencies) {
+            sum_s += seconds(latency);
+            max_s = std::max(max_s, seconds(latency));
+        }
+        res.publish_latency_ms = sum_s / publish_latencies.size() * 1e3;
+        res.publish_latency_max_ms = max_s * 1e3;
+    }
+    return res;
+}
+
+// Drops what fell out of the window. Called with mtx held
+void LinkQuality::expire(time_point now) const {
+    time_point oldest = now - window_;
+    while (!arrivals.empty() && arrivals.front().at < oldest) {
+        arrivals.pop_front();
+    }
+    while (!gaps.empty() && gaps.front() < oldest) {
+        gaps.pop_front();
+    }
+    while (!publish_latencies.empty() && publish_latencies.front().first < oldest) {
+        publish_latencies.pop_front();
+    }
+}
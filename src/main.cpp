@@ -1,3 +1,4 @@
+#include <boost/program_options.hpp>
 #include <chrono>
 #include <cstdlib>
 #include <exception>
@@ -12,100 +13,30 @@
 #include <sstream>
 #include <streambuf>
 #include <string>
+#include <string_view>
 #include <thread>
 
 #include "csv.hpp"
+#include "event_stream.hpp"
 #include "nlohmann/json.hpp"
 #include "rema.hpp"
 #include "restfull_api.hpp"
 #include "session.hpp"
+#include "static_assets.hpp"
 #include "syslogger.hpp"
+#include "traffic_recorder.hpp"
 #include "upload.hpp"
+#include "websocket_api.hpp"
 #include "log_pattern.hpp"
 
-std::vector<std::shared_ptr<restbed::Session>> sse_sessions;
-
 using namespace std::chrono_literals;
 
-const std::map<std::string, std::string> mime_types = { { ".jpg", "image/jpg" },      { ".png", "image/png" },
-                                                        { "svg", "image/svg+xml" },   { ".css", "text/css" },
-                                                        { ".js", "text/javascript" }, { ".ico", "image/x-icon" } };
-
-void register_event_source_handler(const std::shared_ptr<restbed::Session>& session) {
-    const auto headers = std::multimap<std::string, std::string>{
-        { "Connection", "keep-alive" },
-        { "Cache-Control", "no-cache" },
-        { "Content-Type", "text/event-stream" },
-        { "Access-Control-Allow-Origin", "*" } // Only required for demo purposes.
-    };
-
-    session->yield(restbed::OK, headers, [](const std::shared_ptr<restbed::Session>& rest_session_ptr) {
-        sse_sessions.push_back(rest_session_ptr);
-    });
-}
-
-void event_stream_handler() {
-    if (sse_sessions.empty()) {
-        return;
-    }
-
-    static bool hide_sent = false;
-    nlohmann::json res;
-
-    try {
-        res["TELEMETRY"] = rema.ui_telemetry;
-        res["TELEMETRY"]["aligned_coords"] = current_session.transform_point_if_aligned(rema.ui_telemetry.coords, true);
-        res["TELEMETRY"]["aligned_targets"] = current_session.transform_point_if_aligned(rema.ui_telemetry.targets, true);
-        res["TELEMETRY"]["show_target"] = rema.is_sequence_in_progress;
-
-        if (rema.new_temps_available) {
-            rema.new_temps_available = false;
-            res["TEMP_INFO"] = rema.temps;
-        }
-    } catch (std::exception& e) {
-        SPDLOG_ERROR("Telemetry connection lost... {}", e.what());
-    }
-
-    if (!rema.command_client.is_connected || !rema.telemetry_client.is_connected) {
-        res["SHOW_CONNECT"] = true;
-        hide_sent = false;
-    } else {
-        if (!hide_sent) {
-            res["HIDE_CONNECT"] = true;
-            hide_sent = true;
-        }
-    }
-
-    if (current_session.is_loaded && current_session.is_changed) {
-        current_session.save_to_disk();
-        current_session.is_changed = false;
-        res["SESSION_MSG"] = "Session Saved";
-    }
-
-    if (!res.empty()) {
-        sse_sessions.erase(
-            std::remove_if(
-                sse_sessions.begin(),
-                sse_sessions.end(),
-                [](const std::shared_ptr<restbed::Session>& rest_session_ptr) { return rest_session_ptr->is_closed(); }),
-            sse_sessions.end());
-
-        const auto message = "data: " + nlohmann::to_string(res) + "\n\n";
-        for (const auto& session : sse_sessions) {
-            session->yield(message);
-        }
-    }
-}
-
+// /HXs_svg?v= with the hash from current-session/info never changes, another SVG has another hash
 void get_HXs_method_handler(const std::shared_ptr<restbed::Session>& session) {
-    if (current_session.is_loaded) {
-        const std::string body = current_session.hx.tubesheet_svg;
-        std::string content_type = "image/svg+xml";
-
-        const std::multimap<std::string, std::string> headers{ { "Content-Type", content_type },
-                                                               { "Content-Length", std::to_string(body.length()) } };
-
-        session->close(restbed::OK, body, headers);
+    auto content = current_session.hx.tubesheet_svg_content.load();
+    if (current_session.is_loaded && content) {
+        bool versioned = session->get_request()->get_query_parameter("v", "") == content->hash;
+        send_cached(session, *content, versioned ? "public, max-age=31536000, immutable" : "no-cache");
     } else {
         session->close(restbed::NOT_FOUND);
     }
@@ -114,32 +45,29 @@ void get_HXs_method_handler(const std::shared_ptr<restbed::Session>& session) {
 void get_method_handler(const std::shared_ptr<restbed::Session>& session) {
     const auto request = session->get_request();
 
-    const std::string filename = request->get_path_parameter("filename");
-
-    std::filesystem::path file_path{ "./wwwroot/" + request->get_path().substr(std::string("/static/").length()) };
-
-    std::ifstream stream(file_path, std::ifstream::in);
-
-    if (stream.is_open()) {
-        const std::string body = std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
-
-        std::string content_type;
-        std::string ext = file_path.filename().extension();
-        if (auto elem = mime_types.find(ext); elem != mime_types.end()) {
-            content_type = (*elem).second;
-        } else {
-            content_type = "text/html";
-        }
-
-        const std::multimap<std::string, std::string> headers{ { "Content-Type", content_type },
-                                                               { "Content-Length", std::to_string(body.length()) } };
-
-        session->close(restbed::OK, body, headers);
+    // Revalidated on every use, answered with a 304 while the file is unchanged
+    if (auto asset = static_assets.find(request->get_path().substr(std::string("/static/").length()))) {
+        send_cached(session, *asset, "no-cache");
     } else {
         session->close(restbed::NOT_FOUND);
     }
 }
 
+// Name of the first command in a raw request body, found without parsing it. Used only to label metrics
+std::string first_command_name(std::string_view body) {
+    constexpr std::string_view key = "\"cmd\"";
+    auto pos = body.find(key);
+    if (pos == std::string_view::npos) {
+        return "unknown";
+    }
+    pos = body.find('"', body.find(':', pos + key.size()));
+    auto end = body.find('"', pos + 1);
+    if (pos == std::string_view::npos || end == std::string_view::npos) {
+        return "unknown";
+    }
+    return std::string(body.substr(pos + 1, end - pos - 1));
+}
+
 void post_rema_method_handler(const std::shared_ptr<restbed::Session>& session) {
     const auto request = session->get_request();
     uint64_t request_id = request->get_path_parameter("request_id", static_cast<uint64_t>(0));
@@ -151,16 +79,12 @@ void post_rema_method_handler(const std::shared_ptr<restbed::Session>& session)
             std::string tx_buffer(body.begin(), body.end());
 
             try {
-                std::string rema_response;
-                {
-                    std::lock_guard<std::mutex> lock(rema.rtu_mutex);
-                    rema.command_client.send_request(tx_buffer);
-                    rema_response = rema.command_client.get_response();
-                }
+                // The body comes from the UI as is, so it is not tagged and its reply is matched by order
+                std::string rema_response = rema.command_client.request(tx_buffer, request_id, first_command_name(tx_buffer), false).get();
                 if (!rema_response.empty()) {
                     nlohmann::json res;
                     res["request_id"] = request_id;
-                    res["payload"] = nlohmann::json::parse(rema_response);
+                    res["payload"] = CommandNetClient::parse_reply(rema_response);
 
                     std::string stream = res.dump();
                     rest_session_ptr->close(
@@ -193,9 +117,58 @@ void failed_filter_validation_handler(const std::shared_ptr<restbed::Session>& s
     session->close(400);
 }
 
-int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
+// Plays a recording through the same telemetry and logs paths as live RTU traffic
+void replay_recording(std::stop_token stop, const std::filesystem::path &path, double speed) {
+    try {
+        auto stats = traffic::replay(
+            path,
+            speed,
+            { .on_telemetry = [](std::span<const uint8_t> frame) { rema.telemetry_client.inject(frame); },
+              .on_log = [](std::string &line) { rema.logs_client.onReceiveCb(line); },
+              .on_other = {} }, // Commands and replies are kept for inspection only
+            stop);
+
+        double elapsed = std::chrono::duration<double>(stats.elapsed).count();
+        SPDLOG_INFO("Replay finished: {} records, {} telemetry frames, {:.1f} s of traffic in {:.1f} s ({:.0f} frames/s)",
+                    stats.records,
+                    stats.telemetry_frames,
+                    std::chrono::duration<double>(stats.recorded).count(),
+                    elapsed,
+                    elapsed > 0 ? stats.telemetry_frames / elapsed : 0.);
+    } catch (std::exception &e) {
+        SPDLOG_ERROR("Replay failed: {}", e.what());
+    }
+}
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[]) {
     spdlog::set_pattern(log_pattern);
 
+    std::string record_file;
+    std::string replay_file;
+    double replay_speed;
+
+    po::options_description options("REMA proxy");
+    options.add_options()
+        ("help,h", "this help")
+        ("record", po::value<std::string>(&record_file), "record the RTU traffic to this file")
+        ("replay", po::value<std::string>(&replay_file), "replay a recording instead of connecting to the RTU")
+        ("replay-speed", po::value<double>(&replay_speed)->default_value(1.), "replay pace multiplier, 0 as fast as possible");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+    } catch (std::exception &e) {
+        SPDLOG_ERROR(e.what());
+        return 1;
+    }
+    if (vm.count("help") || replay_speed < 0.) {
+        std::cout << options << "\n";
+        return vm.count("help") ? 0 : 1;
+    }
+
     uint16_t rema_proxy_port = 4321;
 
     rema_proxy_port = static_cast<uint16_t>(rema.config["REMA_PROXY"].value("port", 4321));
@@ -203,15 +176,26 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
     int rtu_port = rema.config["REMA"]["network"].value("port", 5020);
     SPDLOG_INFO("REMA Proxy Server running on {}", rema_proxy_port);
 
-    rema.connect(rtu_host, rtu_port);
+    if (!record_file.empty() && !traffic_recorder.open(record_file)) {
+        return 1;
+    }
+
+    std::jthread replay; // Stopped and joined once the service returns, while rema is still alive
+    if (replay_file.empty()) {
+        rema.connect(rtu_host, rtu_port);   // Doesn't wait for the RTU, which may well be off
+    } else {
+        replay = std::jthread(replay_recording, std::filesystem::path(replay_file), replay_speed);
+    }
 
     auto resource_rema = std::make_shared<restbed::Resource>();
     resource_rema->set_path("/REMA/{request_id: .*}");
     resource_rema->set_failed_filter_validation_handler(failed_filter_validation_handler);
+    resource_rema->set_default_header("Cache-Control", "no-store");
     resource_rema->set_method_handler(
         "POST", [](const std::shared_ptr<restbed::Session>& session) { post_rema_method_handler(session); });
 
 
+    static_assets.start();
     auto resource_html_file = std::make_shared<restbed::Resource>();
 
     resource_html_file->set_paths({
@@ -233,27 +217,22 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
     settings->set_port(rema_proxy_port);
     // settings->set_default_header("Connection", "close");
 
+    // Cache-Control is up to each resource, restbed would send a default one along with theirs
     settings->set_default_headers({
         { "Connection", "keep-alive" },
-        { "Cache-Control", "no-store" },
         { "Access-Control-Allow-Origin", "*" } // Only required for demo purposes.
     });
 
     settings->set_worker_limit(std::thread::hardware_concurrency());
 
-    auto resource_server_side_events = std::make_shared<restbed::Resource>();
-    resource_server_side_events->set_path("/sse");
-    resource_server_side_events->set_method_handler("GET", register_event_source_handler);
-
     restbed::Service service;
     service.publish(resource_rema);
     service.publish(resource_HXs);
     service.publish(resource_html_file);
-    service.publish(resource_server_side_events);
     upload_create_endpoints(service);
     restfull_api_create_endpoints(service);
-
-    service.schedule(event_stream_handler, std::chrono::milliseconds(100));
+    event_stream_create_endpoints(service);
+    websocket_api_create_endpoints(service);
 
     service.set_logger(std::make_shared<SyslogLogger>());
 
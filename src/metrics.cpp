@@ -0,0 +1,73 @@
+#include <spdlog/spdlog.h>
+
+#include "metrics.hpp"
+
+uint64_t LatencyHistogram::count_below(uint64_t us) const {
+    uint64_t res = 0;
+    for (std::size_t i = 0; i < bucket_count && upper_bound(i) < us; ++i) {
+        res += buckets[i].load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+namespace {
+    // Prometheus "le" bounds, in microseconds, from 256 us to 67 s. Powers of two are edges of the histogram's own
+    // buckets, so every count is exact. A decimal bound such as 500 us would split a bucket and undercount
+    constexpr int le_min_exponent = 8;
+    constexpr int le_max_exponent = 26;
+
+    std::string escape(const std::string &label_value) {
+        std::string res;
+        for (char c : label_value) {
+            if (c == '\\' || c == '"') {
+                res += '\\';
+            } else if (c == '\n') {
+                res += "\\n";
+                continue;
+            }
+            res += c;
+        }
+        return res;
+    }
+
+    void append_histograms(std::string &out, const HistogramFamily &family, const auto &series) {
+        out += fmt::format("# HELP {} {}\n# TYPE {} histogram\n", family.name, family.help, family.name);
+        for (const auto &[label_value, histogram] : series) {
+            std::string label = fmt::format("{}=\"{}\"", family.label, escape(label_value));
+            for (int exponent = le_min_exponent; exponent <= le_max_exponent; ++exponent) {
+                uint64_t le_us = uint64_t{ 1 } << exponent;
+                out += fmt::format("{}_bucket{{{},le=\"{}\"}} {}\n", family.name, label, le_us * 1e-6,
+                                   histogram->count_below(le_us));
+            }
+            out += fmt::format("{}_bucket{{{},le=\"+Inf\"}} {}\n", family.name, label, histogram->count());
+            out += fmt::format("{}_sum{{{}}} {}\n", family.name, label, histogram->sum_seconds());
+            out += fmt::format("{}_count{{{}}} {}\n", family.name, label, histogram->count());
+        }
+    }
+
+    void append_counters(std::string &out, const CounterFamily &family, const auto &series) {
+        out += fmt::format("# HELP {} {}\n# TYPE {} counter\n", family.name, family.help, family.name);
+        for (const auto &[label_value, counter] : series) {
+            out += fmt::format("{}{{{}=\"{}\"}} {}\n", family.name, family.label, escape(label_value), counter->load());
+        }
+    }
+} // namespace
+
+std::string Metrics::prometheus() const {
+    std::string out;
+    for (const HistogramFamily *family : { &command_rtt, &execute_command, &step, &settle, &telemetry_interarrival,
+                                              &telemetry_publish_latency }) {
+        std::shared_lock<std::shared_mutex> lock(family->mtx);
+        append_histograms(out, *family, family->series);
+    }
+    for (const CounterFamily *family : { &watchdog_expiries, &reconnects, &connections_lost, &frames_dropped,
+                                            &telemetry_gaps, &sse_clients_evicted }) {
+        std::shared_lock<std::shared_mutex> lock(family->mtx);
+        append_counters(out, *family, family->series);
+    }
+    return out;
+}
+
+void prometheus_append(std::string &out, const std::string &name, const std::string &type, const std::string &help, double value) {
+    out += fmt::format("# HELP {} {}\n# TYPE {} {}\n{} {}\n", name, help, name, type, name, value);
+}
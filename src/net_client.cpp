@@ -2,98 +2,156 @@
 
 #include "net_client.hpp"
 #include <fcntl.h>
+#include <future>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <memory>
+#include <poll.h>
+#include <sys/epoll.h>
 
-NetClient::NetClient() {
+NetClient::NetClient(std::size_t min_read_size, std::size_t max_frame_size)
+    : rx_buffer_(min_read_size * 4, max_frame_size), min_read_size_(min_read_size) {
 }
 
 int NetClient::connect(std::string host, int port, int nsec) {
-    // setup variables
-    host_ = host;
-    port_ = port;
+    std::future<int> connected = connect_async(host, port);
+    if (nsec == 0) {
+        connected.wait();
+    }
+    return wait_connected(connected, std::chrono::steady_clock::now() + std::chrono::seconds(nsec));
+}
 
-    struct sockaddr_in server_addr;
+std::future<int> NetClient::connect_async(std::string host, int port) {
+    auto result = std::make_shared<std::promise<int>>();
+    std::future<int> connected = result->get_future();
+    connect_async(host, port, [result](int res) { result->set_value(res); });
+    return connected;
+}
 
-    // use DNS to get IP address
-    struct hostent* hostEntry;
-    hostEntry = gethostbyname(host_.c_str());
-    if (!hostEntry) {
-        SPDLOG_ERROR("No such host name: {}", host_);
-        return -1;
+void NetClient::connect_async(std::string host, int port, std::function<void(int)> on_done) {
+    {
+        std::lock_guard<std::mutex> lock(socket_mtx_);
+        host_ = host;
+        port_ = port;
     }
+    uint64_t attempt = ++connect_attempt_;
+
+    // getaddrinfo blocks as long as DNS takes, so it runs on resolver_ and neither the caller nor the reactor thread,
+    // which serves the other channels, waits for it
+    resolver_.send([this, host, port, attempt, on_done] {
+        struct addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *addresses = nullptr;
+        if (int rc = ::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses); rc != 0) {
+            SPDLOG_ERROR("No such host name: {} ({})", host, gai_strerror(rc));
+            reactor_->post([this, attempt, on_done] {
+                if (attempt == connect_attempt_) {
+                    on_done(-1);
+                }
+            });
+            return;
+        }
+
+        struct sockaddr_storage server_addr;
+        socklen_t server_addr_len = addresses->ai_addrlen;
+        int family = addresses->ai_family;
+        memcpy(&server_addr, addresses->ai_addr, server_addr_len);
+        ::freeaddrinfo(addresses);
 
-    // setup socket address structure
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port_);
-    memcpy(&server_addr.sin_addr, hostEntry->h_addr_list[0], hostEntry->h_length);
+        reactor_->post([this, host, port, attempt, server_addr, server_addr_len, family, on_done] {
+            if (attempt != connect_attempt_) {
+                return; // Dropped by close(), or superseded by another connect_async(), while resolving
+            }
+            connect_resolved(host, port, server_addr, server_addr_len, family, on_done);
+        });
+    });
+}
+
+// Reactor thread
+void NetClient::connect_resolved(const std::string &host,
+                                 int port,
+                                 const struct sockaddr_storage &server_addr,
+                                 socklen_t server_addr_len,
+                                 int family,
+                                 std::function<void(int)> on_done) {
+    teardown(); // Whatever was left belongs to the previous connection
+    rx_buffer_.clear();
+    socket_port_ = port;
 
     // create socket
-    socket_ = socket(PF_INET, SOCK_STREAM, 0);
-    if (!socket_) {
+    int fd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
         SPDLOG_ERROR("Socket creation");
-        return -1;
+        on_done(-errno);
+        return;
     }
 
-    // connect to server
-    int flags, n, error;
-    socklen_t len;
-    fd_set rset, wset;
-    struct timeval tval;
-
-    flags = ::fcntl(socket_, F_GETFL, 0);
-    ::fcntl(socket_, F_SETFL, flags | O_NONBLOCK);
-
-    error = 0;
-    if ((n = ::connect(socket_, reinterpret_cast<const struct sockaddr*>(&server_addr), sizeof(server_addr))) < 0) {
+    if (::connect(fd, reinterpret_cast<const struct sockaddr*>(&server_addr), server_addr_len) < 0) {
         if (errno != EINPROGRESS) {
-            return (-errno);
+            int error = errno;
+            ::close(fd);
+            on_done(-error);
+            return;
         }
     }
-
-    /* Do whatever we want while the connect is taking place. */
     SPDLOG_INFO("Conecting to {}:{}", host, port);
 
-    if (n == 0) {
-        goto done; /* connect completed immediately */
+    {
+        std::lock_guard<std::mutex> lock(socket_mtx_);
+        socket_ = fd;
+        ++connection_;
     }
 
-    FD_ZERO(&rset);
-    FD_SET(socket_, &rset);
-    wset = rset;
-    tval.tv_sec = nsec;
-    tval.tv_usec = 0;
-
-    if ((::select(socket_ + 1, &rset, &wset, nullptr, nsec ? &tval : nullptr)) == 0) {
-        ::close(socket_); /* timeout */
-        errno = ETIMEDOUT;
-        return (-errno);
-    }
+    // The socket becomes writable once the connection is established or has failed
+    reactor_->add(fd, EPOLLOUT, [this, fd, port, on_done](uint32_t) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+            error = errno;
+        }
+        if (error) {
+            teardown();
+            on_done(-error);
+            return;
+        }
 
-    if (FD_ISSET(socket_, &rset) || FD_ISSET(socket_, &wset)) {
-        len = sizeof(error);
-        if (::getsockopt(socket_, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
-            return (-error); /* Solaris pending error */
+        kernel_rx_timestamps_ = false;
+        if (rx_timestamps_wanted_) {
+            int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+            kernel_rx_timestamps_ = ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+            if (!kernel_rx_timestamps_) {
+                SPDLOG_WARN("No kernel receive timestamps on PORT: {} ({}), using the read time", port, strerror(errno));
+            }
         }
-    } else {
-        SPDLOG_ERROR("Select error: sockfd not set");
-    }
 
-done:
-    ::fcntl(socket_, F_SETFL, flags); /* restore file status flags */
+        reactor_->modify(fd, EPOLLIN | EPOLLRDHUP, [this](uint32_t events) { handle_events(events); });
+        is_connected = true;
+        established_ = true;
+        SPDLOG_INFO("Connected to PORT: {}", port);
+        on_connected();
+        on_done(0);
+    });
+}
+
+int NetClient::wait_connected(std::future<int> &connected, std::chrono::steady_clock::time_point deadline) {
+    if (connected.wait_until(deadline) == std::future_status::timeout) {
+        ++connect_attempt_;
+        reactor_->post([this] { teardown(); });
+        return -ETIMEDOUT;
+    }
 
-    if (error) {
-        ::close(socket_); /* just in case */
-        errno = error;
-        return (-errno);
+    try {
+        return connected.get();
+    } catch (const std::future_error &e) {
+        // Superseded by another connect() before this one finished
+        return -ECONNABORTED;
     }
-    is_connected = true;
-    SPDLOG_INFO("Connected to PORT: {}", port_);    
-    return (0);
 }
 
 void NetClient::reconnect() {
     close();
-    connect(host_, port_);
+    connect(get_host(), get_port());
 }
 
 int getSO_ERROR(int fd) {
@@ -120,112 +178,160 @@ void shutdownSocket(int fd) {
 
 void NetClient::close() {
     is_connected = false;
-    shutdownSocket(socket_); // As I'm shutind down socket_ from another thread, use shutdown instead of close
-                             // otherwise the same socket number will be assigned and errno = EBADF
+    ++connect_attempt_; // An attempt still resolving is dropped too
+    // The descriptor itself is released on the reactor thread, so it can't be reused while a handler still refers to it
+    reactor_->post([this] { teardown(); });
 }
 
-bool NetClient::send_request(std::string request) {
-    if (is_connected) {
-        try {
-            // prepare to send request
-            const char *ptr = request.c_str();
-            size_t nleft = request.length();
-            ssize_t nwritten = 0;
-            // loop to be sure it is all sent
-            while (nleft) {
-                if (nwritten = ::send(socket_, ptr, nleft, MSG_NOSIGNAL); nwritten < 0) {
-                    if (errno == EINTR) {
-                        // the socket call was interrupted -- try again
-                        continue;
-                    } else {
-                        // an error occurred, so break out
-                        SPDLOG_ERROR("Error writing to socket");
-                        is_connected = false;
-                        return false;
-                    }
-                } else if (nwritten == 0) {
-                    // the socket is closed
-                    is_connected = false;
-                    return false;
-                }
-                nleft -= nwritten;
-                ptr += nwritten;
-            }
-            return true;
-        } catch (std::exception &e) {
-            is_connected = false;
-            SPDLOG_ERROR("Error sending {}", e.what());
-            return false;
+void NetClient::teardown() {
+    bool was_open = false;
+    bool was_established = established_;
+    established_ = false;
+    {
+        std::lock_guard<std::mutex> lock(socket_mtx_);
+        if (socket_ >= 0) {
+            reactor_->remove(socket_);
+            shutdownSocket(socket_);
+            ::close(socket_);
+            socket_ = -1;
+            was_open = true;
         }
+        is_connected = false;
+    }
+    if (was_open) {
+        on_disconnected();
+    }
+    if (was_established && on_connection_lost) {
+        on_connection_lost();
     }
-    return false;
 }
 
-std::string NetClient::get_response() {
-    if (is_connected) {
-        if (!leftover_buffer.empty()) {            
-            if (std::size_t null_pos; (null_pos = leftover_buffer.find('\0')) != std::string::npos) {
-                std:: string prev = leftover_buffer.substr(0, null_pos);
-                leftover_buffer = leftover_buffer.substr(null_pos + 1);
-                return prev;
-            }
+void NetClient::handle_events([[maybe_unused]] uint32_t events) {
+    bool closed = false;
+    while (true) {
+        char *dst = rx_buffer_.prepare(min_read_size_);
+        if (dst == nullptr) {
+            on_data(); // Makes room unless a single frame fills the buffer
+            dst = rx_buffer_.prepare(min_read_size_);
         }
-                                                            // If something was left on leftover_buffer because no null was found...
-        std::string response = std::move(leftover_buffer);  // start with what was left
-
-        // Read until we get a null character
-        while (true) {
-            ssize_t nread = recv(socket_, buf_, buflen_, 0);
-            if (nread < 0) {
-                if (errno == EINTR) {
-                    // The socket call was interrupted -- try again
-                    continue;
-                } else {
-                    // An error occurred, so return false
-                    return {};
-                }
-            } else if (nread == 0) {
-                // The socket is closed
-                return {};
-            }
-            
-            for (ssize_t i = 0; i < nread; ++i) {
-                if (buf_[i] == '\0') {
-                    // Guardar lo que viene después del carácter nulo en el buffer restante
-                    leftover_buffer.assign(buf_ + i + 1, nread - i - 1);
-                    return response; // Retornar la respuesta acumulada hasta el carácter nulo
-                }
-                response += buf_[i];
+        if (dst == nullptr) {
+            SPDLOG_ERROR("Frame on PORT: {} longer than {} bytes, dropping the connection", socket_port_, rx_buffer_.max_size());
+            rx_buffer_.clear();
+            closed = true;
+            break;
+        }
+        std::size_t room = rx_buffer_.writable();
+        ssize_t nread = receive(dst, room);
+        if (nread > 0) {
+            rx_buffer_.commit(nread);
+            if (static_cast<std::size_t>(nread) < room) {
+                break; // drained
             }
+        } else if (nread < 0 && errno == EINTR) {
+            // The socket call was interrupted -- try again
+            continue;
+        } else if (nread < 0 && errno == EAGAIN) {
+            break;
+        } else {
+            // The socket is closed or an error occurred
+            closed = true;
+            break;
         }
     }
-    return {};
+
+    on_data();
+
+    if (closed) {
+        SPDLOG_WARN("Connection to PORT: {} lost", socket_port_);
+        teardown();
+    }
 }
 
-std::vector<uint8_t> NetClient::get_response_binary() {
-    if (is_connected) {
-        std::vector<uint8_t> response;
-
-        while (true) {
-            ssize_t nread = recv(socket_, buf_, buflen_, 0);
-            if (nread < 0) {
-                if (errno == EINTR) {
-                    // The socket call was interrupted -- try again
-                    continue;
-                } else {
-                    // An error occurred, so return false
-                    return {};
-                }
-            } else if (nread == 0) {
-                // The socket is closed
-                return {};
+// recv() that also updates last_rx_time_. For a stream socket the kernel timestamp is the one of the last segment read
+ssize_t NetClient::receive(char *dst, std::size_t room) {
+    if (!kernel_rx_timestamps_) {
+        ssize_t nread = ::recv(socket_, dst, room, 0);
+        last_rx_time_ = std::chrono::steady_clock::now();
+        return nread;
+    }
+
+    struct iovec iov = { dst, room };
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t nread = ::recvmsg(socket_, &msg, 0);
+    auto steady_now = std::chrono::steady_clock::now();
+    last_rx_time_ = steady_now;
+    if (nread <= 0) {
+        return nread;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPING) {
+            struct scm_timestamping stamps;
+            memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            // Software timestamps are CLOCK_REALTIME, turned into an age to move them to the steady clock. An
+            // implausible age means the wall clock was just stepped, the read time is better then
+            auto stamped = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::seconds(stamps.ts[0].tv_sec) + std::chrono::nanoseconds(stamps.ts[0].tv_nsec)));
+            auto age = std::chrono::system_clock::now() - stamped;
+            if (stamps.ts[0].tv_sec != 0 && age > std::chrono::system_clock::duration::zero() && age < std::chrono::seconds(1)) {
+                last_rx_time_ = steady_now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(age);
             }
+        }
+    }
+    return nread;
+}
 
-            for (ssize_t i = 0; i < nread; ++i) {
-                response.push_back(buf_[i]);
+bool NetClient::send_request(const std::string &request) {
+    // One request at a time, so that their bytes never interleave on the stream
+    std::lock_guard<std::mutex> send_lock(send_mtx_);
+    const char *ptr = request.c_str();
+    size_t nleft = request.length();
+    uint64_t connection = 0;
+    bool broken = false;
+    while (nleft) {
+        int fd;
+        {
+            std::lock_guard<std::mutex> lock(socket_mtx_);
+            if (!is_connected || socket_ < 0 || (connection != 0 && connection != connection_)) {
+                return false; // Closed meanwhile, along with whatever was sent of the request
+            }
+            connection = connection_;
+            fd = socket_;
+            ssize_t nwritten = ::send(fd, ptr, nleft, MSG_NOSIGNAL);
+            if (nwritten > 0) {
+                nleft -= nwritten;
+                ptr += nwritten;
+                continue;
             }
-            return response;
+            if (nwritten < 0 && errno == EINTR) {
+                // the socket call was interrupted -- try again
+                continue;
+            }
+            if (nwritten == 0 || errno != EAGAIN) {
+                SPDLOG_ERROR("Error writing to socket: {}", nwritten == 0 ? "closed" : strerror(errno));
+                broken = true;
+                break;
+            }
+        }
+        // The kernel takes no more for now. Waited for without socket_mtx_, so that teardown() isn't held up
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        if (::poll(&pfd, 1, 1000) <= 0) {
+            SPDLOG_ERROR("Timeout writing to socket");
+            break;
         }
     }
-    return {};
+    if (nleft == 0) {
+        return true;
+    }
+    // Whatever follows a partial request would be read as part of it, the stream can't be used anymore
+    if (broken || nleft < request.length()) {
+        close();
+    }
+    return false;
 }
@@ -0,0 +1,146 @@
+#include <spdlog/spdlog.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "reactor.hpp"
+
+Reactor::Reactor() {
+    epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        SPDLOG_ERROR("Unable to create I/O reactor: {}", strerror(errno));
+        return;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd;
+    ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+    thd = std::jthread([this](std::stop_token stop_token) { run(stop_token); });
+}
+
+Reactor::~Reactor() {
+    stop();
+    if (wake_fd >= 0) {
+        ::close(wake_fd);
+    }
+    if (epoll_fd >= 0) {
+        ::close(epoll_fd);
+    }
+}
+
+void Reactor::stop() {
+    if (thd.joinable()) {
+        thd.request_stop();
+        wakeup();
+        thd.join();
+    }
+}
+
+bool Reactor::add(int fd, uint32_t events, Handler handler) {
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        SPDLOG_ERROR("epoll_ctl ADD {}: {}", fd, strerror(errno));
+        return false;
+    }
+    handlers[fd] = std::move(handler);
+    return true;
+}
+
+bool Reactor::modify(int fd, uint32_t events, Handler handler) {
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        SPDLOG_ERROR("epoll_ctl MOD {}: {}", fd, strerror(errno));
+        return false;
+    }
+    handlers[fd] = std::move(handler);
+    return true;
+}
+
+void Reactor::remove(int fd) {
+    ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    handlers.erase(fd);
+}
+
+void Reactor::post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(tasks_mtx);
+        tasks.push_back(std::move(task));
+    }
+    wakeup();
+}
+
+void Reactor::post_after(std::chrono::steady_clock::duration delay, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(tasks_mtx);
+        timers.emplace(std::chrono::steady_clock::now() + delay, std::move(task));
+    }
+    wakeup(); // the loop may have to wait less than it planned
+}
+
+void Reactor::wakeup() {
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = ::write(wake_fd, &one, sizeof(one));
+}
+
+void Reactor::run(std::stop_token stop_token) {
+    constexpr int max_events = 16;
+    struct epoll_event events[max_events];
+    std::vector<Task> pending_tasks;
+
+    while (!stop_token.stop_requested()) {
+        int timeout_ms = -1;
+        {
+            std::lock_guard<std::mutex> lock(tasks_mtx);
+            if (!timers.empty()) {
+                auto wait = timers.begin()->first - std::chrono::steady_clock::now();
+                // round up, waking early would just spin until the timer is due
+                auto wait_ms = std::chrono::ceil<std::chrono::milliseconds>(wait).count();
+                timeout_ms = wait_ms > 0 ? static_cast<int>(wait_ms) : 0;
+            }
+        }
+
+        int n = ::epoll_wait(epoll_fd, events, max_events, timeout_ms);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            SPDLOG_ERROR("epoll_wait: {}", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd) {
+                uint64_t count;
+                [[maybe_unused]] ssize_t r = ::read(wake_fd, &count, sizeof(count));
+                continue;
+            }
+            // Look the handler up at dispatch time, an earlier handler in this batch may have removed it
+            if (auto it = handlers.find(fd); it != handlers.end()) {
+                Handler handler = it->second; // the handler may replace or remove itself
+                handler(events[i].events);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(tasks_mtx);
+            pending_tasks.swap(tasks);
+            auto now = std::chrono::steady_clock::now();
+            while (!timers.empty() && timers.begin()->first <= now) {
+                pending_tasks.push_back(std::move(timers.begin()->second));
+                timers.erase(timers.begin());
+            }
+        }
+        for (auto &task : pending_tasks) {
+            task();
+        }
+        pending_tasks.clear();
+    }
+}
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <map>
 #include <memory>
+#include <set>
 #include <spdlog/spdlog.h>
 #include <string>
 #include <variant>
@@ -14,18 +15,39 @@
 #include "rema.hpp"
 #include "session.hpp"
 #include "chart.hpp"
+#include "event_stream.hpp"
+#include "metrics.hpp"
+#include "msgpack_decode.hpp"
 #include "tool.hpp"
 
 REMA::REMA() {
 
     spdlog::set_pattern(log_pattern);
 
+    command_client.set_reactor(reactor);
+    telemetry_client.set_reactor(reactor);
+    logs_client.set_reactor(reactor);
+
+    supervisor.add_channel("command", command_client, 0, true, [this] {
+        if (command_client.negotiate_encoding()) {
+            send_startup_commands();
+        }
+    });
+    supervisor.add_channel("telemetry", telemetry_client, 1, true, [this] { telemetry_client.start(); });
+    supervisor.add_channel("logs", logs_client, 2, false);
+    supervisor.set_on_change([] { event_stream.publish(EventStream::CONNECTION); });
+
     telemetry_client.set_on_receive_callback(
-        [&](std::vector<uint8_t>& line) { 
-            update_telemetry(line);
+        [&](std::span<const uint8_t> frame, std::chrono::steady_clock::time_point received_at) {
+            update_telemetry(frame, received_at);
         }
     );
 
+    ui_stage = std::jthread([this](std::stop_token stop) {
+        std::stop_callback wake(stop, [this] { ui_queue.close(); });
+        run_ui_stage();
+    });
+
     logs_client.set_on_receive_callback(
         [&](std::string& line) { 
             save_logs(line); 
@@ -40,32 +62,49 @@ REMA::REMA() {
             std::filesystem::create_directories(logs_dir);
         }
 
-        logs_ofstream.open(log_file, std::ios::app);
-        SPDLOG_INFO("Saving logs to ./{}", log_file.string());
+        if (rtu_log.open(log_file)) {
+            SPDLOG_INFO("Saving logs to ./{}", log_file.string());
+        }
 
         load_config();
+        std::map<std::string, Tool> tools;
         for (const auto &entry : std::filesystem::directory_iterator(tools_dir)) {
             Tool t(entry.path());
             tools[entry.path().filename().replace_extension()] = t;
         }
+        std::string selected = config["REMA"].is_object() ? config["REMA"].value("last_selected_tool", "") : "";
+        tools_.store(std::make_shared<const ToolRegistry>(std::move(tools), selected, current_session.hx.scale));
         this->loaded = true;
     } catch (std::exception &e) {
         SPDLOG_WARN(e.what());
     }
 }
 
+REMA::~REMA() {
+    reactor.stop();
+}
+
 void REMA::add_tool(const Tool &tool) {
-    tools[tool.name] = tool;
+    std::lock_guard<std::mutex> lock(tools_edit_mtx);
+    tools_.store(tool_registry()->with_tool(tool), std::memory_order_release);
 }
 
 void REMA::delete_tool(const std::string &tool) {
     std::filesystem::remove(tools_dir / (tool + std::string(".json")));
-    tools.erase(tool);
+    std::lock_guard<std::mutex> lock(tools_edit_mtx);
+    tools_.store(tool_registry()->without_tool(tool), std::memory_order_release);
+}
+
+// Keeps the tools' precomputed UI offsets in the units of the current session
+void REMA::set_tools_ui_scale(double ui_scale) {
+    std::lock_guard<std::mutex> lock(tools_edit_mtx);
+    tools_.store(tool_registry()->with_ui_scale(ui_scale), std::memory_order_release);
 }
 
 void REMA::cancel_sequence_in_progress() {
     while (is_sequence_in_progress) {
         cancel_sequence = true;
+        notify_telemetry_waiters();
         std::this_thread::sleep_for(std::chrono::milliseconds(100)); // Avoid hogging the processor
     }
 }
@@ -75,7 +114,13 @@ void REMA::load_config() {
         std::ifstream config_file(config_file_path);
         if (config_file.is_open()) {
             config_file >> config;
-            this->last_selected_tool = config["REMA"]["last_selected_tool"];
+            if (config["REMA"].contains("settle")) {
+                const auto &settle = config["REMA"]["settle"];
+                settle_params.window = settle.value("window", settle_params.window);
+                settle_params.tolerance = settle.value("tolerance", settle_params.tolerance);
+                settle_params.timeout =
+                    std::chrono::milliseconds(settle.value("timeout_ms", settle_params.timeout.count()));
+            }
         } else {
             SPDLOG_WARN("{} not found", config_file_path.string());
             std::exit(1);
@@ -108,82 +153,126 @@ nlohmann::json REMA::send_startup_commands() {
 void REMA::save_config() {
     std::ofstream file(config_file_path);
     // Default JSON deserialization not possible because REMA is not default constructible (to enforce singleton pattern)
-    config["REMA"]["last_selected_tool"] = last_selected_tool;
+    config["REMA"]["last_selected_tool"] = tool_registry()->selected_name();
     file << config;
 }
 
 void REMA::connect(const std::string &rtu_host, int rtu_port) {
     rtu_host_ = rtu_host;
     rtu_port_ = rtu_port;
-    if (command_client.connect(rtu_host, rtu_port) < 0) {
-        SPDLOG_WARN("Unable to connect to Command endpoint");
-    } else {
-        send_startup_commands();
-    };
-
-    if (telemetry_client.connect(rtu_host, rtu_port + 1) < 0) {
-        SPDLOG_WARN("Unable to connect to Telemetry endpoint");
-    } else {
-        telemetry_client.start();
-    }
-
-    if (logs_client.connect(rtu_host, rtu_port + 2) < 0) {
-        SPDLOG_WARN("Unable to connect to Logs endpoint");
-    } else {
-        logs_client.start();
-    }
-
+    supervisor.connect(rtu_host, rtu_port);     // Returns at once, the supervisor keeps retrying on its own
 }
 
 void REMA::reconnect() {
-    command_client.close();
-    telemetry_client.close();   // this would probably be closed by watchdog
-    logs_client.close();
-    connect(rtu_host_, rtu_port_);
+    supervisor.connect(rtu_host_, rtu_port_);
 }
 
-void REMA::update_telemetry(std::vector<uint8_t>& stream) {
-    nlohmann::json json;    
+void REMA::update_telemetry(std::span<const uint8_t> frame, std::chrono::steady_clock::time_point received_at) {
+    if (frame.empty()) {
+        return;
+    }
+
     try {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (!stream.empty()) {
-            json = nlohmann::json::from_msgpack(stream);
-
-            if (json.contains("telemetry")) {
-                telemetry = json["telemetry"];
-                ui_telemetry = rema.telemetry;
-                Tool tool = rema.get_selected_tool();
-                ui_telemetry.coords = current_session.from_rema_to_ui(rema.telemetry.coords, &tool);
-                ui_telemetry.targets = current_session.from_rema_to_ui(rema.telemetry.targets, &tool);
-
-                if (ui_telemetry.joystick_movement.x_y != old_telemetry.joystick_movement.x_y && ui_telemetry.joystick_movement.x_y) {
-                    chart.init("joystick_movement_XY");
-                }
-
-                if (ui_telemetry.joystick_movement.z != old_telemetry.joystick_movement.z && ui_telemetry.joystick_movement.z) {
-                    chart.init("joystick_movement_Z");
-                }
-
-                if (ui_telemetry.coords != old_telemetry.coords) {
-                    chart.insertData({ui_telemetry.coords});
-                }
-                old_telemetry = ui_telemetry;
+        // Decoded into copies, so a malformed frame leaves the last good values in place
+        struct telemetry new_telemetry = telemetry.load();
+        struct temps new_temps = temps.load();
+        bool has_telemetry = false;
+        bool has_temps = false;
+
+        msgpack_decode::Reader reader(frame.data(), frame.size());
+        uint32_t entries;
+        bool ok = reader.map_header(entries);
+        for (uint32_t i = 0; ok && i < entries; ++i) {
+            std::string_view key;
+            if (!(ok = reader.str(key))) {
+                break;
+            }
+            if (key == "telemetry") {
+                ok = has_telemetry = msgpack_decode::read(reader, new_telemetry);
+            } else if (key == "temps") {
+                ok = has_temps = msgpack_decode::read(reader, new_temps);
+            } else {
+                ok = reader.skip();
             }
+        }
+        if (!ok) {
+            throw std::runtime_error("Malformed telemetry frame");
+        }
 
-            if (json.contains("temps")) {
-                new_temps_available = true;
-                temps = json["temps"];
+        if (has_telemetry) {
+            telemetry.store(new_telemetry);
+            telemetry_history.push(received_at, new_telemetry);
+            if (!ui_queue.try_push({ received_at, new_telemetry })) {
+                static std::atomic<uint64_t> &frames_dropped = metrics.frames_dropped["ui"];
+                ++frames_dropped;
             }
         }
+
+        if (has_temps) {
+            temps.store(new_temps);
+            event_stream.publish(EventStream::TEMPS);
+        }
+
+        if (has_telemetry) {
+            notify_telemetry_waiters();
+        }
     } catch (std::exception &e) {
+        ++telemetry_client.frames_undecodable;
         SPDLOG_ERROR("TELEMETRY COMMUNICATIONS ERROR {}", e.what());
     }
 }
 
+// UI stage of the telemetry pipeline, on its own thread so that the receive thread only decodes and publishes.
+// Converts to UI units for the selected tool, detects joystick movements starting and feeds the chart
+void REMA::run_ui_stage() {
+    TelemetryHistory::Entry frame;
+    while (ui_queue.pop(frame)) {
+        try {
+            struct telemetry new_ui_telemetry = frame.telemetry;
+            auto tools = tool_registry();
+            new_ui_telemetry.coords = tools->to_ui(frame.telemetry.coords);
+            new_ui_telemetry.targets = tools->to_ui(frame.telemetry.targets);
+            ui_telemetry.store(new_ui_telemetry);
+            ui_telemetry_received_at.store(frame.time);
+            event_stream.publish(EventStream::TELEMETRY);
+
+            if (new_ui_telemetry.joystick_movement.x_y != old_telemetry.joystick_movement.x_y && new_ui_telemetry.joystick_movement.x_y) {
+                chart.init("joystick_movement_XY");
+            }
+
+            if (new_ui_telemetry.joystick_movement.z != old_telemetry.joystick_movement.z && new_ui_telemetry.joystick_movement.z) {
+                chart.init("joystick_movement_Z");
+            }
+
+            if (new_ui_telemetry.coords != old_telemetry.coords) {
+                chart.insertData({new_ui_telemetry.coords});
+            }
+            old_telemetry = new_ui_telemetry;
+        } catch (std::exception &e) {
+            SPDLOG_ERROR("TELEMETRY UI CONVERSION ERROR {}", e.what());
+        }
+    }
+}
+
+// Blocks until a telemetry frame newer than version is published or the sequence is cancelled.
+// Returns false if neither happened within timeout
+bool REMA::wait_for_telemetry(uint64_t version, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(telemetry_update_mtx);
+    return telemetry_updated.wait_for(lock, timeout, [&] { return telemetry.version() != version || cancel_sequence; });
+}
+
+void REMA::notify_telemetry_waiters() {
+    {
+        // Empty critical section: a waiter is either before its predicate check or already waiting, never in between
+        std::lock_guard<std::mutex> lock(telemetry_update_mtx);
+    }
+    telemetry_updated.notify_all();
+}
+
 void REMA::save_logs(std::string &stream) {
     try {
-        logs_ofstream << stream << std::endl;
-        logs_vector.push_back(stream);
+        rtu_log.add(stream);
+        event_stream.publish(EventStream::LOGS);
     } catch (std::exception &e) {
         SPDLOG_ERROR("LOGS STORAGE ERROR {}", e.what());
     }
@@ -201,31 +290,27 @@ void REMA::set_home_z(double z) {
     execute_command("SET_COORDS", { { "position_Z", z } });
 }
 
-void REMA::execute_command_no_wait(
+std::future<std::string> REMA::execute_command_async(
     const std::string cmd_name,
     const nlohmann::json pars) { // do not change command to a reference
-    nlohmann::json to_rema;
-
-    nlohmann::json command;
-    command["cmd"] = cmd_name;
-    if (!pars.is_null()) {
-        command["pars"] = pars;
-    }
-
-    to_rema.push_back(command);
-    std::string tx_buffer = to_rema.dump();
+    uint64_t request_id = command_client.next_request_id();
+    SPDLOG_INFO("Sending to REMA: {} ({})", cmd_name, request_id);
+    SPDLOG_DEBUG("{} pars: {}", cmd_name, pars.dump());
+    return command_client.command(cmd_name, pars, request_id);
+}
 
-    SPDLOG_INFO("Sending to REMA: {}", tx_buffer);
-    {
-        std::lock_guard<std::mutex> lock(rtu_mutex);
-        command_client.send_request(tx_buffer);
-    }
+void REMA::execute_command_no_wait(
+    const std::string cmd_name,
+    const nlohmann::json pars) { // do not change command to a reference
+    execute_command_async(cmd_name, pars);  // The reply is still matched, nobody waits for it
 }
 
 nlohmann::json
 REMA::execute_command(const std::string cmd_name, const nlohmann::json pars) { // do not change command to a reference
-    execute_command_no_wait(cmd_name, pars);
-    return nlohmann::json::parse(command_client.get_response());
+    auto start = std::chrono::steady_clock::now();
+    nlohmann::json res = CommandNetClient::parse_reply(execute_command_async(cmd_name, pars).get());
+    metrics.execute_command[CommandNetClient::metric_label(cmd_name)].record(std::chrono::steady_clock::now() - start);
+    return res;
 }
 
 nlohmann::json REMA::move_closed_loop(movement_cmd cmd) {
@@ -242,47 +327,129 @@ void REMA::axes_hard_stop_all() {
     execute_command("AXES_HARD_STOP_ALL");
 }
 
+// dir is one of left, right, up, down, z_in or z_out, or a diagonal as in "up_left"
+tl::expected<nlohmann::json, std::string> REMA::move_joystick(const std::string &dir) {
+    static const std::set<std::string> directions = { "left",      "right",      "up",   "down",  "up_left", "up_right",
+                                                      "down_left", "down_right", "z_in", "z_out" };
+    if (!directions.contains(dir)) {
+        return tl::make_unexpected("Unknown joystick direction: " + dir); // Before stopping anything
+    }
+
+    nlohmann::json pars_obj;
+
+    if (dir.find("left") != std::string::npos) {
+        pars_obj["axes"] = "XY";
+        pars_obj["first_axis_setpoint"] = MAX_NEGATIVE_SETPOINT;
+    }
+
+    if (dir.find("right") != std::string::npos) {
+        pars_obj["axes"] = "XY";
+        pars_obj["first_axis_setpoint"] = MAX_POSITIVE_SETPOINT;
+    }
+
+    if (dir.find("up") != std::string::npos) {
+        pars_obj["axes"] = "XY";
+        pars_obj["second_axis_setpoint"] = MAX_POSITIVE_SETPOINT;
+    }
+
+    if (dir.find("down") != std::string::npos) {
+        pars_obj["axes"] = "XY";
+        pars_obj["second_axis_setpoint"] = MAX_NEGATIVE_SETPOINT;
+    }
+
+    if (dir.find("z_in") != std::string::npos) {
+        pars_obj["axes"] = "Z";
+        pars_obj["first_axis_setpoint"] = MAX_POSITIVE_SETPOINT;
+    }
+
+    if (dir.find("z_out") != std::string::npos) {
+        pars_obj["axes"] = "Z";
+        pars_obj["first_axis_setpoint"] = MAX_NEGATIVE_SETPOINT;
+    }
+
+    axes_soft_stop_all();
+
+    chart.init("joystick");
+    return execute_command("MOVE_JOYSTICK", pars_obj);
+}
+
 void REMA::axes_soft_stop_all() {
     cancel_sequence_in_progress();
     execute_command("AXES_SOFT_STOP_ALL");
 }
 
 tl::expected<void, std::string> REMA::execute_step(movement_cmd& step) {
+    auto start = std::chrono::steady_clock::now();
     nlohmann::json cmd_response = move_closed_loop(step);
     if (cmd_response["MOVE_CLOSED_LOOP"].contains("error")) {
         is_sequence_in_progress = false;
         return tl::make_unexpected(cmd_response["MOVE_CLOSED_LOOP"]["error"]);
     }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(400)); // Wait for telemetry update...
+    // Frames already on their way when the RTU took the command may still carry the previous step's stop flags.
+    // The second frame published after the reply is the first one certain to reflect this move
+    uint64_t seen = telemetry.version();
+    const uint64_t armed_at = seen + 2;
 
     bool stopped_on_probe = false;
     bool stopped_on_condition = false;
     bool abort_from_rema = false;
-    do {
+    struct telemetry snapshot;
+    while (!cancel_sequence) {
+        if (!wait_for_telemetry(seen, std::chrono::milliseconds(500))) {
+            continue; // no telemetry for a while, the supervisor will bring it back or the user will cancel
+        }
+        seen = telemetry.version();
+        if (seen < armed_at) {
+            continue;
+        }
+
+        snapshot = telemetry.load();
         if (step.axes == "XY") {
-            stopped_on_probe = telemetry.probe.x_y;
-            stopped_on_condition = telemetry.on_condition.x_y;
+            stopped_on_probe = snapshot.probe.x_y;
+            stopped_on_condition = snapshot.on_condition.x_y;
         } else {
-            stopped_on_probe = telemetry.probe.z;
-            stopped_on_condition = telemetry.on_condition.z;
+            stopped_on_probe = snapshot.probe.z;
+            stopped_on_condition = snapshot.on_condition.z;
         }
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(100)); // Avoid hogging the processor
-        abort_from_rema = !telemetry.control_enabled || telemetry.stalled.x || telemetry.stalled.y ||
-                            telemetry.stalled.z || telemetry.probe_protected;
-    } while (!(stopped_on_probe || stopped_on_condition || cancel_sequence || abort_from_rema));
+        abort_from_rema = !snapshot.control_enabled || snapshot.stalled.x || snapshot.stalled.y ||
+                            snapshot.stalled.z || snapshot.probe_protected;
+        if (stopped_on_probe || stopped_on_condition || abort_from_rema) {
+            break;
+        }
+    }
 
     if (cancel_sequence || abort_from_rema) {
         is_sequence_in_progress = false;
         return tl::make_unexpected("Sequence cancelled");            
     } else {
         step.executed = true;
-        step.execution_results.coords = telemetry.coords;
+        step.execution_results.coords = snapshot.coords;
         step.execution_results.stopped_on_probe = stopped_on_probe;
         step.execution_results.stopped_on_condition = stopped_on_condition;
+        metrics.step[step.axes].record(std::chrono::steady_clock::now() - start);
+    }
+
+    // Wait for vibrations to stop before the next move, the stop frame being the first sample
+    auto stopped_at = std::chrono::steady_clock::now();
+    auto settle_deadline = stopped_at + settle_params.timeout;
+    SettleDetector settle(settle_params);
+    bool settled = settle.add(snapshot.coords);
+    while (!settled && !cancel_sequence && std::chrono::steady_clock::now() < settle_deadline) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(settle_deadline - std::chrono::steady_clock::now());
+        if (!wait_for_telemetry(seen, remaining)) {
+            break;
+        }
+        seen = telemetry.version();
+        settled = settle.add(telemetry.load().coords);
+    }
+    auto settle_time = std::chrono::steady_clock::now() - stopped_at;
+    step.execution_results.settled = settled;
+    step.execution_results.settle_time = std::chrono::duration_cast<std::chrono::milliseconds>(settle_time);
+    metrics.settle[step.axes].record(settle_time);
+    if (!settled && !cancel_sequence) {
+        SPDLOG_WARN("Axes {} not settled after {} ms", step.axes, settle_params.timeout.count());
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(250)); // Wait for vibrations to stop
     return {};
 }
 
@@ -325,7 +492,7 @@ nlohmann::json REMA::would_move_touch_probe(std::string new_tool_string) {
     nlohmann::json res = nlohmann::json::object();
     Tool new_tool = get_tool(new_tool_string);
     if (get_selected_tool().is_touch_probe != new_tool.is_touch_probe) {
-        if (!telemetry.control_enabled) {
+        if (!telemetry.load().control_enabled) {
             res["error"]="CONTROL IS DISABLED";
         } else {
             std::string message = "⚠️ WARNING: CRITICAL OPERATION ⚠️\n\n";
@@ -343,40 +510,41 @@ nlohmann::json REMA::would_move_touch_probe(std::string new_tool_string) {
 }
 
 tl::expected<void, std::string> REMA::set_last_selected_tool(std::string tool) {
-    std::string prev_last_selected_tool = last_selected_tool;
-    if (tool != last_selected_tool) {
-        if (get_selected_tool().is_touch_probe) {
+    // Tool changes wait for each other, as they may move the touch probe, but tools_edit_mtx is only taken to publish
+    // the result, so other edits don't wait for the RTU
+    std::lock_guard<std::mutex> select_lock(tool_select_mtx);
+    auto current = tool_registry();
+    if (tool != current->selected_name()) {
+        if (current->selected().is_touch_probe) {
             auto ret = retract_touch_probe();
             if (!ret) {
                 return ret;
             }
         }
 
-        last_selected_tool = tool;
-        if (get_selected_tool().is_touch_probe) {
+        if (const Tool *next = current->find(tool); next && next->is_touch_probe) {
             auto ret = extend_touch_probe();
             if (!ret) {
-                last_selected_tool = prev_last_selected_tool;
                 return ret;
             }
         }
+
+        std::lock_guard<std::mutex> lock(tools_edit_mtx);
+        tools_.store(tool_registry()->with_selected(tool), std::memory_order_release); // Keeps edits made meanwhile
         save_config();
     }
     return {};
 }
 
 Tool REMA::get_tool(std::string tool) const {
-    if (auto iter = tools.find(tool); iter != tools.end()) {
-        return iter->second;
+    if (const Tool *found = tool_registry()->find(tool)) {
+        return *found;
     }
     return {};
 }
 
 Tool REMA::get_selected_tool() const {
-    if (auto iter = tools.find(last_selected_tool); iter != tools.end()) {
-        return iter->second;
-    }
-    return {};
+    return tool_registry()->selected();
 }
 
 tl::expected<void, std::string> REMA::extend_touch_probe() {
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <memory>
 #include <spdlog/spdlog.h>
+#include <sstream>
 #include <thread>
 #include <vector>
 
@@ -14,6 +15,7 @@
 #include "circle_fns.hpp"
 #include "nlohmann/json.hpp"
 #include "magic_enum/magic_enum.hpp"
+#include "metrics.hpp"
 #include "misc_fns.hpp"
 #include "points.hpp"
 #include "rema.hpp"
@@ -21,9 +23,6 @@
 #include "tool.hpp"
 #include "chart.hpp"
 
-// These value goes into bresenham error determination that needs to be multiplied by 2
-constexpr int MAX_POSITIVE_SETPOINT = 999999999; 
-constexpr int MAX_NEGATIVE_SETPOINT = -MAX_POSITIVE_SETPOINT;
 
 
 void close_rest_session(const std::shared_ptr<restbed::Session>& rest_session, int status) {
@@ -59,7 +58,7 @@ void REMA_connect(const std::shared_ptr<restbed::Session>& rest_session) {
     try {
         rema.reconnect();
         status = restbed::OK;
-        res = "Connected";
+        res = "Reconnecting";
     } catch (std::exception &e) {
         res = e.what();
         status = restbed::INTERNAL_SERVER_ERROR;
@@ -70,15 +69,20 @@ void REMA_connect(const std::shared_ptr<restbed::Session>& rest_session) {
 void REMA_info(const std::shared_ptr<restbed::Session>& rest_session) {
     nlohmann::json res = nlohmann::json(nlohmann::json::value_t::object);
 
+    auto tools = rema.tool_registry();
     std::map<std::string, Tool> tools_to_ui;
-    for (auto [id, tool] : REMA::tools) {
+    for (const auto &[id, tool] : tools->tools()) {
         tools_to_ui[id] = Tool(id, (tool.offset * current_session.hx.scale), tool.is_touch_probe);
     }
 
     res["tools"] = tools_to_ui;
-    res["last_selected_tool"] = rema.last_selected_tool;
+    res["last_selected_tool"] = tools->selected_name();
     res["host"] = rema.command_client.get_host();
     res["service"] = rema.command_client.get_port();
+    res["connection"] = rema.supervisor.status();
+    res["telemetry_frames"] = { { "received", rema.telemetry_client.frames_received.load() },
+                                { "undecodable", rema.telemetry_client.frames_undecodable.load() } };
+    res["telemetry_link"] = rema.telemetry_client.link_quality.snapshot();
     close_rest_session(rest_session, restbed::OK, res);
 }
 
@@ -138,7 +142,7 @@ void plans_delete(const std::shared_ptr<restbed::Session>& rest_session) {
 
 void tools_list(const std::shared_ptr<restbed::Session>& rest_session) {
     std::map<std::string, Tool> tools_to_ui;
-    for (auto [id, tool] : REMA::tools) {
+    for (const auto &[id, tool] : rema.tool_registry()->tools()) {
         tools_to_ui[id] = Tool(id, (tool.offset * current_session.hx.scale), tool.is_touch_probe);
     }
     close_rest_session(rest_session, restbed::OK, tools_to_ui);
@@ -148,7 +152,7 @@ void tools_info(const std::shared_ptr<restbed::Session>& rest_session) {
     const auto request = rest_session->get_request();
     std::string tool_name = request->get_path_parameter("tool_name", "");
 
-    auto tool_to_ui = REMA::tools.at(tool_name);
+    auto tool_to_ui = rema.tool_registry()->tools().at(tool_name);
     tool_to_ui.offset *= current_session.hx.scale;
     close_rest_session(rest_session, restbed::OK, tool_to_ui);
 }
@@ -181,7 +185,7 @@ void tools_add_update(const std::shared_ptr<restbed::Session> rest_session) {
 
                     Tool new_tool(tool_name, offsets, is_touch_probe);
                     new_tool.save_to_disk();
-                    REMA::add_tool(new_tool);
+                    rema.add_tool(new_tool);
                     res = "Tool Added/Updated Successfully";
                     status = restbed::CREATED;
                 }
@@ -203,7 +207,7 @@ void tools_delete(const std::shared_ptr<restbed::Session>& rest_session) {
     std::string res;
     int status = restbed::OK;
     try {
-        REMA::delete_tool(tool_name);
+        rema.delete_tool(tool_name);
         status = restbed::NO_CONTENT;
     } catch (const std::filesystem::filesystem_error &e) {
         res = "Failed to delete the tool";
@@ -277,6 +281,7 @@ void sessions_create(const std::shared_ptr<restbed::Session>& rest_session) {
                     res = new_session.load_plans();
                     new_session.save_to_disk();
                     current_session = new_session;
+                    rema.set_tools_ui_scale(current_session.hx.scale);
                     status = restbed::CREATED;
                 }
             } catch (const std::exception &e) {
@@ -295,8 +300,7 @@ void sessions_load(const std::shared_ptr<restbed::Session>& rest_session) {
     if (!session_name.empty()) {
         try {
             current_session.load(session_name);
-            current_session.hx.process_csv_from_disk(current_session.hx_dir);
-            current_session.hx.generate_svg();            
+            rema.set_tools_ui_scale(current_session.hx.scale);  // Set from the HX config that load() read
 
             status = restbed::OK;
         } catch (std::exception &e) {
@@ -312,6 +316,11 @@ void sessions_load(const std::shared_ptr<restbed::Session>& rest_session) {
 
 void current_session_info(const std::shared_ptr<restbed::Session>& rest_session) {
     nlohmann::json res = current_session;
+    // The SVG itself comes from /HXs_svg?v=, which the browser keeps
+    res["hx"].erase("tubesheet_svg");
+    if (auto content = current_session.hx.tubesheet_svg_content.load()) {
+        res["hx"]["tubesheet_svg_hash"] = content->hash;
+    }
     if (current_session.is_loaded) {
         auto aligned_tubes = current_session.calculate_aligned_tubes();         // Done before to update is_aligned;
         res["aligned_tubes"] = aligned_tubes;
@@ -454,44 +463,12 @@ void move_joystick(const std::shared_ptr<restbed::Session>& rest_session) {
     const auto request = rest_session->get_request();
     std::string dir = request->get_path_parameter("dir", "");
 
-    nlohmann::json pars_obj;
-
-    if (dir.find("left") != std::string::npos) {
-        pars_obj["axes"] = "XY";
-        pars_obj["first_axis_setpoint"] = MAX_NEGATIVE_SETPOINT;
-    }
-
-    if (dir.find("right") != std::string::npos) {
-        pars_obj["axes"] = "XY";
-        pars_obj["first_axis_setpoint"] = MAX_POSITIVE_SETPOINT;
-    }
-
-    if (dir.find("up") != std::string::npos) {
-        pars_obj["axes"] = "XY";
-        pars_obj["second_axis_setpoint"] = MAX_POSITIVE_SETPOINT;
-    }
-
-    if (dir.find("down") != std::string::npos) {
-        pars_obj["axes"] = "XY";
-        pars_obj["second_axis_setpoint"] = MAX_NEGATIVE_SETPOINT;
-    }
-
-    if (dir.find("z_in") != std::string::npos) {
-        pars_obj["axes"] = "Z";
-        pars_obj["first_axis_setpoint"] = MAX_POSITIVE_SETPOINT;
-    }
-
-    if (dir.find("z_out") != std::string::npos) {
-        pars_obj["axes"] = "Z";
-        pars_obj["first_axis_setpoint"] = MAX_NEGATIVE_SETPOINT;
+    auto res = rema.move_joystick(dir);
+    if (!res) {
+        close_rest_session(rest_session, restbed::BAD_REQUEST, nlohmann::json{ { "error", res.error() } });
+        return;
     }
-
-    rema.axes_soft_stop_all();
-    
-    chart.init("joystick");
-    nlohmann::json res = rema.execute_command("MOVE_JOYSTICK", pars_obj);
-    
-    close_rest_session(rest_session, restbed::OK, res);
+    close_rest_session(rest_session, restbed::OK, *res);
 }
 
 bool equals(double f1, double f2) {
@@ -517,28 +494,16 @@ void network_settings(const std::shared_ptr<restbed::Session>& rest_session) {
                     rema.config["REMA"]["network"]["port"] = rtu_port;
                     rema.save_config();
 
-                    rema.telemetry_client.close();      // Doing this else wont connect after restart
-                    rema.logs_client.close();           // Doing this else wont connect after restart
-                    // Do not close rema.command_client becaus it is needed to send the network parameters
-
                     pars["ipaddr"] = rtu_host;
                     pars["port"] = rtu_port;
                     pars["gw"] = form_data["ipaddr"];
                     pars["netmask"] = "255.255.255.0";
                     rema.execute_command_no_wait("NETWORK_SETTINGS", pars);
 
-                    for (int retry = 0; retry < 3; ++retry) {
-                        try {
-                            rema.connect(rtu_host, rtu_port);
-                        } catch (const std::exception &e) {
-                            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-                            SPDLOG_INFO("Retrying...");
-                        }
-                        if (rema.command_client.is_connected && rema.telemetry_client.is_connected) {
-                            break;
-                        }
-                    }
-                    close_rest_session(rest_session_ptr, restbed::OK);                    
+                    // The RTU restarts its network, the supervisor keeps retrying the new endpoint until it is back
+                    rema.connect(rtu_host, rtu_port);
+                    close_rest_session(rest_session_ptr, restbed::OK);
+                    return;
                 }
                 close_rest_session(rest_session_ptr, restbed::BAD_REQUEST);
             } else {
@@ -646,7 +611,7 @@ void determine_tube_center(const std::shared_ptr<restbed::Session>& rest_session
     if (!tube_id.empty()) {
         double tube_radius = current_session.hx.tube_od / 2;
         Point3D ideal_center = current_session.get_tube_coordinates(tube_id, false);
-        Point3D initial_center = rema.telemetry.coords;
+        Point3D initial_center = rema.telemetry.load().coords;
 
         constexpr int points_number = 3;
         static_assert(points_number % 2 != 0, "Number of points must be odd");
@@ -886,9 +851,84 @@ void charts_delete(const std::shared_ptr<restbed::Session>& rest_session) {
     close_rest_session(rest_session, status, res);
 }
 
+void metrics_get(const std::shared_ptr<restbed::Session>& rest_session) {
+    std::string res = metrics.prometheus();
+    prometheus_append(res, "rema_telemetry_frames_total", "counter", "Telemetry frames received",
+                      rema.telemetry_client.frames_received.load());
+    prometheus_append(res, "rema_telemetry_frames_undecodable_total", "counter", "Telemetry frames that could not be decoded",
+                      rema.telemetry_client.frames_undecodable.load());
+    auto link = rema.telemetry_client.link_quality.snapshot();
+    prometheus_append(res, "rema_telemetry_fps", "gauge", "Telemetry frames per second, last 5 s", link.fps);
+    prometheus_append(res, "rema_telemetry_jitter_seconds", "gauge", "Telemetry interarrival standard deviation, last 5 s",
+                      link.jitter_ms * 1e-3);
+    rest_session->close(
+        restbed::OK,
+        res,
+        { { "Content-Type", "text/plain; version=0.0.4; charset=utf-8" }, { "Content-Length", std::to_string(res.length()) } });
+}
+
+// Telemetry frames received between since and until, Unix time in ms, either of them negative meaning that many ms
+// before now. fields optionally picks telemetry members, comma separated
+void telemetry_history_get(const std::shared_ptr<restbed::Session>& rest_session) {
+    const auto request = rest_session->get_request();
+    using namespace std::chrono;
+
+    auto steady_now = steady_clock::now();
+    auto system_now = system_clock::now();
+    auto to_steady = [&](int64_t ms) {
+        if (ms < 0) {
+            return steady_now + milliseconds(ms);
+        }
+        return steady_now + duration_cast<steady_clock::duration>(milliseconds(ms) - system_now.time_since_epoch());
+    };
+    auto to_unix_ms = [&](steady_clock::time_point time) {
+        return duration_cast<milliseconds>(system_now.time_since_epoch() + (time - steady_now)).count();
+    };
+
+    steady_clock::time_point since;
+    steady_clock::time_point until;
+    std::vector<std::string> fields;
+    try {
+        std::string since_par = request->get_query_parameter("since", "");
+        std::string until_par = request->get_query_parameter("until", "");
+        since = since_par.empty() ? steady_clock::time_point::min() : to_steady(std::stoll(since_par));
+        until = until_par.empty() ? steady_now : to_steady(std::stoll(until_par));
+        std::stringstream fields_par(request->get_query_parameter("fields", ""));
+        for (std::string field; std::getline(fields_par, field, ',');) {
+            if (!field.empty()) {
+                fields.push_back(field);
+            }
+        }
+    } catch (std::exception &e) {
+        close_rest_session(rest_session, restbed::BAD_REQUEST, std::string("Invalid since or until"));
+        return;
+    }
+
+    nlohmann::json res = nlohmann::json::array();
+    for (const auto &entry : rema.telemetry_history.range(since, until)) {
+        nlohmann::json frame = entry.telemetry;
+        if (!fields.empty()) {
+            nlohmann::json selected = nlohmann::json::object();
+            for (const auto &field : fields) {
+                if (frame.contains(field)) {
+                    selected[field] = std::move(frame[field]);
+                }
+            }
+            frame = std::move(selected);
+        }
+        frame["t"] = to_unix_ms(entry.time);
+        res.push_back(std::move(frame));
+    }
+    close_rest_session(rest_session, restbed::OK, res);
+}
+
 void logs(const std::shared_ptr<restbed::Session>& rest_session) {
-    close_rest_session(rest_session, restbed::OK, rema.logs_vector);
-    rema.logs_vector.clear();
+    // The lines still kept, and the number to follow them from with /sse?topics=logs&logs_from=
+    auto kept = rema.rtu_log.since(0);
+    nlohmann::json res;
+    res["lines"] = kept.lines;
+    res["next"] = kept.next;
+    close_rest_session(rest_session, restbed::OK, res);
 }
 
 // @formatter:off
@@ -938,6 +978,8 @@ void restfull_api_create_endpoints(restbed::Service &service) {
         { "charts", { { "GET", &charts_list } } },
         { "charts/{chart_file: .*}", { { "GET", &get_chart } , { "DELETE", &charts_delete } } },      
         { "logs", { { "GET", &logs } } },
+        { "metrics", { { "GET", &metrics_get } } },
+        { "telemetry/history", { { "GET", &telemetry_history_get } } },
     };
     // @formatter:on
 
@@ -945,6 +987,7 @@ void restfull_api_create_endpoints(restbed::Service &service) {
     for (auto [path, resources] : rest_resources) {
         auto resource_rest = std::make_shared<restbed::Resource>();
         resource_rest->set_path(std::string("/REST/").append(path));
+        resource_rest->set_default_header("Cache-Control", "no-store");
         // resource_rest->set_failed_filter_validation_handler(
         //         failed_filter_validation_handler);
 
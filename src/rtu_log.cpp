@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#include "rtu_log.hpp"
+
+bool RtuLog::open(const std::filesystem::path &path) {
+    close();
+
+    file.open(path, std::ios::app);
+    if (!file) {
+        SPDLOG_ERROR("Can't save logs to {}", path.string());
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        writing = true;
+    }
+    writer = std::jthread([this](std::stop_token stop) { write_queued(stop); });
+    return true;
+}
+
+void RtuLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        writing = false; // Under the lock, so nothing is queued after the writer's last look
+    }
+    if (writer.joinable()) {
+        writer.request_stop();
+        writer.join();
+    }
+    if (file.is_open()) {
+        file.close();
+    }
+}
+
+void RtuLog::add(const std::string &line) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (kept.size() == max_kept) {
+            kept.pop_front();
+        }
+        kept.push_back(line);
+        ++added;
+        if (writing) {
+            unwritten.push_back(line);
+        }
+    }
+    unwritten_cv.notify_one();
+}
+
+RtuLog::Lines RtuLog::since(uint64_t from, uint64_t until) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint64_t first = added - kept.size();
+    uint64_t begin = std::clamp(from, first, added);
+    uint64_t end = std::clamp(until, begin, added);
+    Lines res;
+    res.lines.assign(kept.begin() + static_cast<std::ptrdiff_t>(begin - first),
+                     kept.begin() + static_cast<std::ptrdiff_t>(end - first));
+    res.next = end;
+    return res;
+}
+
+void RtuLog::write_queued(std::stop_token stop) {
+    std::vector<std::string> batch; // Swapped with unwritten, so both keep their capacity
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            unwritten_cv.wait(lock, stop, [this] { return !unwritten.empty(); });
+            batch.swap(unwritten);
+        }
+        if (batch.empty()) {
+            return; // Stopped with nothing left
+        }
+        for (const auto &line : batch) {
+            file << line << '\n';
+        }
+        file.flush(); // Once per batch, lines that come together are written together
+        batch.clear();
+        if (!file) {
+            SPDLOG_ERROR("Can't save logs to file anymore");
+            std::lock_guard<std::mutex> lock(mtx);
+            writing = false;
+            unwritten.clear();
+            return;
+        }
+    }
+}
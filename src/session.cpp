@@ -9,6 +9,7 @@
 #include <string>
 
 #include "session.hpp"
+#include "event_stream.hpp"
 
 Session::Session() : transformation_matrix(Eigen::Matrix4d::Identity()) {};
 
@@ -35,6 +36,10 @@ bool Session::load(const std::string& session_name) {
     // nlohmann::json json;
     // i_file_stream >> json;
     from_json_from_disk(nlohmann::json::parse(i_file_stream));
+    // The HX's CSV and config may have changed since the session was saved. The SVG, and the compressed copy that
+    // /HXs_svg serves, are built from them here and nowhere else on load
+    hx.process_csv_from_disk(hx_dir);
+    hx.generate_svg();
 
     is_loaded = true;
     name = session_name;
@@ -142,6 +147,12 @@ std::vector<Session> Session::sessions_list() {
     return res;
 }
 
+// Saved, and the clients told, by the event stream
+void Session::mark_changed() {
+    is_changed = true;
+    event_stream.publish(EventStream::SESSION);
+}
+
 void Session::save_to_disk() const {
     std::filesystem::path session_file = sessions_dir / (name + std::string(".json"));
     std::ofstream file(session_file);
@@ -151,7 +162,7 @@ void Session::save_to_disk() const {
 
 void Session::set_selected_plan(std::string& plan) {
     last_selected_plan = plan;
-    is_changed = true;
+    mark_changed();
 }
 
 std::string Session::get_selected_plan() const {
@@ -160,7 +171,8 @@ std::string Session::get_selected_plan() const {
 
 void Session::set_tube_executed(std::string& plan, std::string& tube_id, bool state) {
     plans[plan][tube_id].executed = state;
-    is_changed = true;
+    mark_changed();
+    event_stream.publish_tube_executed(plan, tube_id, state);
 }
 
 int Session::total_tubes_in_plans() {
@@ -189,12 +201,12 @@ void Session::cal_points_add_update(
         row, col, ideal_coords, determined_coords
     };
     cal_points[tube_id] = cpe;
-    is_changed = true;
+    mark_changed();
 }
 
 void Session::cal_points_delete(const std::string& tube_id) {
     cal_points.erase(tube_id);
-    is_changed = true;
+    mark_changed();
 }
 
 Point3D Session::get_tube_coordinates(const std::string& tube_id, bool ideal = true) {
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <string_view>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "static_assets.hpp"
+
+namespace {
+    const std::map<std::string, std::string> mime_types = { { ".jpg", "image/jpg" },      { ".png", "image/png" },
+                                                            { ".svg", "image/svg+xml" },  { ".css", "text/css" },
+                                                            { ".js", "text/javascript" }, { ".ico", "image/x-icon" },
+                                                            { ".csv", "text/csv" },       { ".json", "application/json" } };
+
+    std::string content_type_of(const std::filesystem::path &path) {
+        if (auto elem = mime_types.find(path.extension()); elem != mime_types.end()) {
+            return elem->second;
+        }
+        return "text/html";
+    }
+
+    std::string trim(std::string_view s) {
+        auto begin = s.find_first_not_of(" \t");
+        auto end = s.find_last_not_of(" \t");
+        return begin == std::string_view::npos ? std::string() : std::string(s.substr(begin, end - begin + 1));
+    }
+
+    // q of an Accept-Encoding item, 1 without one and 0 if it doesn't parse
+    double quality(const std::string &item) {
+        if (auto q = item.find("q="); q != std::string::npos) {
+            try {
+                return std::stod(item.substr(q + 2));
+            } catch (std::exception &) {
+                return 0.;
+            }
+        }
+        return 1.;
+    }
+} // namespace
+
+namespace http_headers {
+
+    bool accepts(const std::string &accept_encoding, std::string_view coding) {
+        std::istringstream list(accept_encoding);
+        std::string item;
+        bool wildcard = false;
+        while (std::getline(list, item, ',')) {
+            std::string name = trim(item.substr(0, item.find(';')));
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+            if (name == coding) {
+                return quality(item) > 0.; // Listed by name, whatever * says
+            }
+            if (name == "*") {
+                wildcard = quality(item) > 0.;
+            }
+        }
+        return wildcard;
+    }
+
+    bool none_match(const std::string &if_none_match, const std::string &hash) {
+        std::istringstream list(if_none_match);
+        std::string item;
+        while (std::getline(list, item, ',')) {
+            std::string tag = trim(item);
+            if (tag == "*") {
+                return true;
+            }
+            if (tag.starts_with("W/")) {
+                tag.erase(0, 2);
+            }
+            if (tag.size() > 2 && tag.front() == '"' && tag.back() == '"' && tag.substr(1, hash.size()) == hash &&
+                (tag.size() == hash.size() + 2 || tag[hash.size() + 1] == '-')) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+} // namespace http_headers
+
+void send_cached(const std::shared_ptr<restbed::Session> &session, const CachedContent &content,
+                 const std::string &cache_control) {
+    const auto request = session->get_request();
+    const std::string accept_encoding = request->get_header("Accept-Encoding", "");
+
+    const std::string *body = &content.identity;
+    std::string encoding;
+    std::string etag = content.hash;
+    if (!content.brotli.empty() && http_headers::accepts(accept_encoding, "br")) {
+        body = &content.brotli;
+        encoding = "br";
+        etag += "-br";
+    } else if (!content.gzip.empty() && http_headers::accepts(accept_encoding, "gzip")) {
+        body = &content.gzip;
+        encoding = "gzip";
+        etag += "-gz";
+    }
+
+    std::multimap<std::string, std::string> headers{ { "ETag", "\"" + etag + "\"" },
+                                                     { "Cache-Control", cache_control },
+                                                     { "Vary", "Accept-Encoding" } };
+
+    if (http_headers::none_match(request->get_header("If-None-Match", ""), content.hash)) {
+        session->close(restbed::NOT_MODIFIED, headers);
+        return;
+    }
+
+    headers.emplace("Content-Type", content.content_type);
+    headers.emplace("Content-Length", std::to_string(body->size()));
+    if (!encoding.empty()) {
+        headers.emplace("Content-Encoding", encoding);
+    }
+    session->close(restbed::OK, *body, headers);
+}
+
+void StaticAssets::start() {
+    auto started_at = std::chrono::steady_clock::now();
+
+    // Watching first, so that nothing changes unnoticed while loading
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        SPDLOG_WARN("No inotify, changes to {} need a restart: {}", root.string(), strerror(errno));
+    } else {
+        add_watches("");
+    }
+
+    std::size_t files = 0;
+    std::size_t identity = 0;
+    std::size_t gzip = 0;
+    std::size_t brotli = 0;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(root, ec); !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (!it->is_regular_file()) {
+            continue;
+        }
+        std::string relative = it->path().lexically_relative(root).generic_string();
+        if (auto content = load(relative)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            assets[relative] = content;
+            ++files;
+            identity += content->identity.size();
+            gzip += content->gzip.empty() ? content->identity.size() : content->gzip.size();
+            brotli += content->brotli.empty() ? content->identity.size() : content->brotli.size();
+        }
+    }
+    if (ec) {
+        SPDLOG_ERROR("Reading {}: {}", root.string(), ec.message());
+    }
+
+    SPDLOG_INFO("Static assets: {} files, {} KB, {} KB gzip, {} KB brotli, loaded in {} ms",
+                files, identity / 1024, gzip / 1024, brotli / 1024,
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started_at).count());
+
+    if (inotify_fd >= 0) {
+        watcher = std::jthread([this](std::stop_token stop) { watch(stop); });
+    }
+}
+
+std::shared_ptr<const CachedContent> StaticAssets::find(const std::string &relative) {
+    uint64_t loaded_generation;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (auto elem = assets.find(relative); elem != assets.end()) {
+            return elem->second;
+        }
+        loaded_generation = generation;
+    }
+
+    auto content = load(relative);
+    if (content) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (generation == loaded_generation) {
+            assets[relative] = content;
+        }
+    }
+    return content;
+}
+
+std::shared_ptr<const CachedContent> StaticAssets::load(const std::string &relative) const {
+    std::filesystem::path path = std::filesystem::path(relative).lexically_normal();
+    if (path.is_absolute() || path.empty() || *path.begin() == "..") {
+        return nullptr;
+    }
+    path = root / path;
+    std::ifstream stream(path, std::ifstream::in | std::ifstream::binary);
+    if (!stream.is_open()) {
+        return nullptr;
+    }
+    std::string body(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>{});
+    return CachedContent::make(std::move(body), content_type_of(path));
+}
+
+void StaticAssets::invalidate(const std::string &relative) {
+    std::lock_guard<std::mutex> lock(mtx);
+    ++generation;
+    if (relative.empty()) {
+        assets.clear();
+        return;
+    }
+    // A directory takes everything below it along
+    std::string prefix = relative + "/";
+    for (auto it = assets.begin(); it != assets.end();) {
+        it = it->first == relative || it->first.starts_with(prefix) ? assets.erase(it) : std::next(it);
+    }
+}
+
+// The directory and everything below it
+void StaticAssets::add_watches(const std::string &relative) {
+    constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_ONLYDIR;
+    auto add = [&](const std::filesystem::path &dir) {
+        int wd = inotify_add_watch(inotify_fd, dir.c_str(), mask);
+        if (wd < 0) {
+            SPDLOG_WARN("inotify can't watch {}: {}", dir.string(), strerror(errno));
+            return;
+        }
+        std::string rel = dir.lexically_relative(root).generic_string();
+        directories[wd] = rel == "." ? "" : rel;
+    };
+
+    std::filesystem::path top = root / relative;
+    add(top);
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(top, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_directory()) {
+            add(it->path());
+        }
+    }
+}
+
+void StaticAssets::watch(std::stop_token stop) {
+    alignas(inotify_event) char buffer[4096];
+    while (!stop.stop_requested()) {
+        pollfd pfd{ inotify_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 500) <= 0) { // Timeout to notice the stop request
+            continue;
+        }
+        ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            continue;
+        }
+        bool overflow = false;
+        for (char *p = buffer; p < buffer + len;) {
+            auto *event = reinterpret_cast<inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                directories.erase(event->wd);
+                continue;
+            }
+            auto dir = directories.find(event->wd);
+            if (dir == directories.end()) {
+                continue;
+            }
+            std::string relative = dir->second;
+            if (event->len > 0) {
+                relative = relative.empty() ? std::string(event->name) : relative + "/" + event->name;
+            }
+            SPDLOG_DEBUG("Static asset changed: {}", relative);
+            invalidate(relative);
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                add_watches(relative);
+            }
+        }
+        if (overflow) {
+            SPDLOG_WARN("inotify queue overflow, dropping every static asset");
+            invalidate("");
+        }
+    }
+    close(inotify_fd);
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <utility>
+
+#include "traffic_recorder.hpp"
+
+namespace traffic {
+
+    namespace {
+        constexpr char magic[8] = { 'R', 'E', 'M', 'A', 'R', 'E', 'C', 1 };
+        constexpr std::size_t header_size = 1 + 8 + 4;
+        constexpr std::size_t file_buffer_size = 1 << 20;
+        constexpr std::size_t max_queued = 16 << 20;
+        constexpr auto flush_period = std::chrono::seconds(1); // What an abrupt end of the proxy can lose at most
+
+        void put_le(char *out, uint64_t v, int bytes) {
+            for (int i = 0; i < bytes; ++i) {
+                out[i] = static_cast<char>((v >> (8 * i)) & 0xff);
+            }
+        }
+
+        uint64_t get_le(const char *in, int bytes) {
+            uint64_t v = 0;
+            for (int i = bytes - 1; i >= 0; --i) {
+                v = (v << 8) | static_cast<uint8_t>(in[i]);
+            }
+            return v;
+        }
+    } // namespace
+
+    bool Recorder::open(const std::filesystem::path &path) {
+        close();
+
+        file_buffer.resize(file_buffer_size);
+        file.rdbuf()->pubsetbuf(file_buffer.data(), static_cast<std::streamsize>(file_buffer.size()));
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            SPDLOG_ERROR("Can't record to {}", path.string());
+            return false;
+        }
+        file.write(magic, sizeof(magic));
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queued.clear();
+            dropped = 0;
+            started_at = std::chrono::steady_clock::now();
+            recording = true;
+        }
+        writer = std::jthread([this](std::stop_token stop) { write_queued(stop); });
+        SPDLOG_INFO("Recording RTU traffic to {}", path.string());
+        return true;
+    }
+
+    void Recorder::close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            recording = false; // Under the lock, so nothing is queued after the writer's last look
+        }
+        if (writer.joinable()) {
+            writer.request_stop();
+            writer.join();
+        }
+        if (file.is_open()) {
+            file.close();
+        }
+    }
+
+    void Recorder::record(Record kind, std::span<const uint8_t> payload) {
+        if (!is_recording()) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!recording) {
+                return;
+            }
+            if (queued.size() + header_size + payload.size() > max_queued) {
+                ++dropped;
+                return;
+            }
+            char header[header_size];
+            header[0] = static_cast<char>(kind);
+            put_le(header + 1, std::chrono::duration_cast<std::chrono::microseconds>(now - started_at).count(), 8);
+            put_le(header + 9, payload.size(), 4);
+            queued.insert(queued.end(), header, header + header_size);
+            queued.insert(queued.end(), payload.begin(), payload.end());
+        }
+        queued_cv.notify_one();
+    }
+
+    void Recorder::write_queued(std::stop_token stop) {
+        std::vector<char> batch; // Swapped with queued, so both keep their capacity
+        auto last_flush = std::chrono::steady_clock::now();
+        bool unflushed = false;
+        while (true) {
+            uint64_t lost;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                queued_cv.wait_until(lock, stop, last_flush + flush_period, [this] { return !queued.empty(); });
+                batch.swap(queued);
+                lost = std::exchange(dropped, 0);
+            }
+            if (lost) {
+                SPDLOG_WARN("Recording can't keep up, {} records dropped", lost);
+            }
+
+            bool drained = batch.empty();
+            if (!drained) {
+                file.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+                batch.clear();
+                unflushed = true;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (unflushed && (now - last_flush >= flush_period || stop.stop_requested())) {
+                file.flush();
+                last_flush = now;
+                unflushed = false;
+            }
+            if (!file) {
+                SPDLOG_ERROR("Recording stopped, can't write to file");
+                std::lock_guard<std::mutex> lock(mtx);
+                recording = false;
+                queued.clear();
+                return;
+            }
+            if (drained && stop.stop_requested()) {
+                return;
+            }
+        }
+    }
+
+    ReplayStats replay(const std::filesystem::path &path, double speed, const ReplayHandlers &handlers, std::stop_token stop) {
+        std::ifstream file(path, std::ios::binary);
+        char file_magic[sizeof(magic)];
+        if (!file.read(file_magic, sizeof(file_magic)) || !std::equal(std::begin(magic), std::end(magic), file_magic)) {
+            throw std::runtime_error(path.string() + " is not a REMA traffic recording");
+        }
+
+        ReplayStats stats;
+        auto started_at = std::chrono::steady_clock::now();
+        std::vector<uint8_t> payload;
+        std::string line;
+        std::mutex sleep_mtx;
+        std::condition_variable_any sleep_cv; // Never notified, a stop request cuts the wait short
+        char header[header_size];
+        while (!stop.stop_requested() && file.read(header, sizeof(header))) {
+            auto kind = static_cast<Record>(header[0]);
+            std::chrono::microseconds at(get_le(header + 1, 8));
+            payload.resize(get_le(header + 9, 4));
+            if (!file.read(reinterpret_cast<char *>(payload.data()), static_cast<std::streamsize>(payload.size()))) {
+                SPDLOG_WARN("Recording truncated after {} records", stats.records);
+                break;
+            }
+
+            if (speed > 0) {
+                std::unique_lock<std::mutex> lock(sleep_mtx);
+                auto due = started_at + std::chrono::duration_cast<std::chrono::steady_clock::duration>(at / speed);
+                sleep_cv.wait_until(lock, stop, due, [] { return false; });
+                if (stop.stop_requested()) {
+                    break;
+                }
+            }
+
+            switch (kind) {
+            case Record::TELEMETRY:
+                ++stats.telemetry_frames;
+                if (handlers.on_telemetry) {
+                    handlers.on_telemetry(payload);
+                }
+                break;
+            case Record::LOG:
+                if (handlers.on_log) {
+                    line.assign(payload.begin(), payload.end());
+                    handlers.on_log(line);
+                }
+                break;
+            default:
+                if (handlers.on_other) {
+                    handlers.on_other(kind, payload);
+                }
+            }
+            ++stats.records;
+            stats.recorded = at;
+        }
+        stats.elapsed = std::chrono::steady_clock::now() - started_at;
+        return stats;
+    }
+
+} // namespace traffic
@@ -100,6 +100,7 @@ void upload_create_endpoints(restbed::Service &service) {
 
     auto resource_upload = std::make_shared<restbed::Resource>();
     resource_upload->set_path("/upload/{asset: .*}");
+    resource_upload->set_default_header("Cache-Control", "no-store");
     // resource_upload->set_failed_filter_validation_handler(
     //         failed_filter_validation_handler);
     resource_upload->set_method_handler("POST", file_upload_handler);
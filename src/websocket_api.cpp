@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <openssl/sha.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+#include "event_stream.hpp"
+#include "metrics.hpp"
+#include "rema.hpp"
+#include "session.hpp"
+#include "websocket_api.hpp"
+
+namespace {
+    constexpr std::size_t telemetry_frame_size = 112;
+
+    // A socket and its outbound telemetry, a single send in flight and only the latest frame waiting
+    struct Observer {
+        std::shared_ptr<restbed::WebSocket> socket;
+        bool telemetry = false;
+        bool sending = false;
+        restbed::Bytes queued;
+    };
+
+    std::mutex observers_mtx;
+    std::map<std::string, std::shared_ptr<Observer>> observers; // By socket key
+
+    std::string lowercase(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+        return s;
+    }
+
+    std::string base64(const unsigned char *data, std::size_t len) {
+        static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string res;
+        for (std::size_t i = 0; i < len; i += 3) {
+            uint32_t n = data[i] << 16;
+            if (i + 1 < len) {
+                n |= data[i + 1] << 8;
+            }
+            if (i + 2 < len) {
+                n |= data[i + 2];
+            }
+            res += alphabet[(n >> 18) & 0x3f];
+            res += alphabet[(n >> 12) & 0x3f];
+            res += i + 1 < len ? alphabet[(n >> 6) & 0x3f] : '=';
+            res += i + 2 < len ? alphabet[n & 0x3f] : '=';
+        }
+        return res;
+    }
+
+    // RFC 6455 handshake
+    std::string accept_key(const std::string &key) {
+        std::string challenge = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+        unsigned char digest[SHA_DIGEST_LENGTH];
+        SHA1(reinterpret_cast<const unsigned char *>(challenge.data()), challenge.size(), digest);
+        return base64(digest, sizeof(digest));
+    }
+
+    template <typename T> void put_le(restbed::Bytes &out, std::size_t offset, T value) {
+        using U = std::conditional_t<sizeof(T) == 8, uint64_t, std::conditional_t<sizeof(T) == 4, uint32_t, std::conditional_t<sizeof(T) == 2, uint16_t, uint8_t>>>;
+        U bits = std::bit_cast<U>(value);
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            out[offset + i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+
+    void put_point(restbed::Bytes &out, std::size_t offset, const Point3D &point) {
+        put_le(out, offset, point.x);
+        put_le(out, offset + 8, point.y);
+        put_le(out, offset + 16, point.z);
+    }
+
+    // The layout is documented in websocket_api.hpp
+    restbed::Bytes encode_telemetry(const struct telemetry &t, bool show_target, uint32_t sequence) {
+        const bool bits[] = { t.control_enabled,     t.stall_control,       t.probe_protected,   show_target,
+                              t.on_condition.x_y,    t.on_condition.z,      t.joystick_movement.x_y,
+                              t.joystick_movement.z, t.probe.x_y,           t.probe.z,           t.stalled.x,
+                              t.stalled.y,           t.stalled.z,           t.limits.left,       t.limits.right,
+                              t.limits.up,           t.limits.down,         t.limits.in,         t.limits.out,
+                              t.limits.probe };
+        uint32_t flags = 0;
+        for (std::size_t i = 0; i < std::size(bits); ++i) {
+            flags |= static_cast<uint32_t>(bits[i]) << i;
+        }
+
+        restbed::Bytes res(telemetry_frame_size, 0);
+        res[0] = 1;
+        res[1] = static_cast<uint8_t>(t.brakes_mode);
+        put_le(res, 4, flags);
+        put_le(res, 8, sequence);
+        put_point(res, 16, t.coords);
+        put_point(res, 40, t.targets);
+        put_point(res, 64, current_session.transform_point_if_aligned(t.coords, true));
+        put_point(res, 88, current_session.transform_point_if_aligned(t.targets, true));
+        return res;
+    }
+
+    // With observers_mtx held: the frame to send next, marked in flight, or nothing
+    restbed::Bytes next_send(Observer &observer) {
+        if (observer.sending || observer.queued.empty()) {
+            return {};
+        }
+        observer.sending = true;
+        restbed::Bytes frame = std::move(observer.queued);
+        observer.queued.clear();
+        return frame;
+    }
+
+    // Without observers_mtx. Chains itself while frames keep arriving
+    void send(const std::shared_ptr<Observer> &observer, const restbed::Bytes &frame) {
+        if (frame.empty()) {
+            return;
+        }
+        observer->socket->send(frame, [observer](const std::shared_ptr<restbed::WebSocket>) {
+            restbed::Bytes next;
+            {
+                std::lock_guard<std::mutex> lock(observers_mtx);
+                observer->sending = false;
+                next = next_send(*observer);
+            }
+            send(observer, next);
+        });
+    }
+
+    // Broadcaster thread, once per telemetry frame
+    void broadcast_telemetry(uint32_t topics) {
+        if (!(topics & EventStream::TELEMETRY)) {
+            return;
+        }
+        static std::atomic<uint64_t> &frames_dropped = metrics.frames_dropped["ws"];
+        std::vector<std::pair<std::shared_ptr<Observer>, restbed::Bytes>> sends;
+        {
+            std::lock_guard<std::mutex> lock(observers_mtx);
+            restbed::Bytes frame;
+            for (auto iter = observers.begin(); iter != observers.end();) {
+                auto &observer = iter->second;
+                if (!observer->socket->is_open()) {
+                    iter = observers.erase(iter); // Closed without its close handler being called
+                    continue;
+                }
+                if (!observer->telemetry) {
+                    ++iter;
+                    continue;
+                }
+                if (frame.empty()) {
+                    frame = encode_telemetry(rema.ui_telemetry.load(),
+                                             rema.is_sequence_in_progress,
+                                             static_cast<uint32_t>(rema.ui_telemetry.version()));
+                }
+                if (!observer->queued.empty()) {
+                    ++frames_dropped;
+                }
+                observer->queued = frame;
+                if (auto next = next_send(*observer); !next.empty()) {
+                    sends.emplace_back(observer, std::move(next));
+                }
+            }
+        }
+        for (const auto &[observer, frame] : sends) {
+            send(observer, frame);
+        }
+    }
+
+    tl::expected<nlohmann::json, std::string> execute(const std::string &command) {
+        if (command == "SS") {
+            rema.axes_soft_stop_all();
+            return nlohmann::json::object();
+        }
+        if (command == "HS") {
+            rema.axes_hard_stop_all();
+            return nlohmann::json::object();
+        }
+        return rema.move_joystick(command);
+    }
+
+    void message_handler(const std::shared_ptr<restbed::WebSocket> &socket,
+                         const std::shared_ptr<restbed::WebSocketMessage> &message) {
+        switch (message->get_opcode()) {
+        case restbed::WebSocketMessage::CONNECTION_CLOSE_FRAME:
+            socket->close();
+            break;
+        case restbed::WebSocketMessage::PING_FRAME:
+            socket->send(restbed::WebSocketMessage::PONG_FRAME);
+            break;
+        case restbed::WebSocketMessage::TEXT_FRAME: {
+            auto data = message->get_data();
+            std::string command(data.begin(), data.end());
+            nlohmann::json res;
+            try {
+                // The joystick page sends JSON encoded strings
+                if (auto parsed = nlohmann::json::parse(command, nullptr, false); parsed.is_string()) {
+                    command = parsed.get<std::string>();
+                }
+                res["cmd"] = command;
+                if (auto result = execute(command)) {
+                    res["result"] = *result;
+                } else {
+                    res["error"] = result.error();
+                }
+            } catch (std::exception &e) {
+                res["cmd"] = command;
+                res["error"] = e.what();
+            }
+            socket->send(res.dump());
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void remove_observer(const std::shared_ptr<restbed::WebSocket> &socket) {
+        std::lock_guard<std::mutex> lock(observers_mtx);
+        observers.erase(socket->get_key());
+    }
+
+    // Browsers send the page's origin with every WebSocket handshake, and don't apply the same origin policy to it,
+    // so a page from any other site could otherwise drive the axes. Clients that aren't browsers send no Origin
+    bool same_origin(const std::string &origin, const std::string &host) {
+        if (origin.empty()) {
+            return true;
+        }
+        auto scheme_end = origin.find("://");
+        return scheme_end != std::string::npos && !host.empty() &&
+               lowercase(origin.substr(scheme_end + 3)) == lowercase(host);
+    }
+
+    void websocket_handler(const std::shared_ptr<restbed::Session> &session) {
+        const auto request = session->get_request();
+        const std::string key = request->get_header("Sec-WebSocket-Key", "");
+        if (lowercase(request->get_header("Upgrade", "")) != "websocket" ||
+            lowercase(request->get_header("Connection", "")).find("upgrade") == std::string::npos ||
+            key.size() != 24) { // Base64 of 16 bytes
+            session->close(restbed::BAD_REQUEST);
+            return;
+        }
+        if (request->get_header("Sec-WebSocket-Version", "") != "13") {
+            session->close(restbed::BAD_REQUEST, { { "Sec-WebSocket-Version", "13" } });
+            return;
+        }
+        if (!same_origin(request->get_header("Origin", ""), request->get_header("Host", ""))) {
+            SPDLOG_WARN("WebSocket from {} refused, not the proxy's origin", request->get_header("Origin", ""));
+            session->close(restbed::FORBIDDEN);
+            return;
+        }
+
+        auto observer = std::make_shared<Observer>();
+        std::string telemetry = request->get_query_parameter("telemetry", "");
+        observer->telemetry = telemetry == "1" || telemetry == "true";
+
+        session->set_header("Connection", "Upgrade");
+        const std::multimap<std::string, std::string> headers{
+            { "Upgrade", "websocket" },
+            { "Sec-WebSocket-Accept", accept_key(key) },
+        };
+        session->upgrade(restbed::SWITCHING_PROTOCOLS, headers, [observer](const std::shared_ptr<restbed::WebSocket> socket) {
+            if (!socket->is_open()) {
+                return;
+            }
+            socket->set_close_handler(remove_observer);
+            socket->set_error_handler([](const std::shared_ptr<restbed::WebSocket> failed, const std::error_code error) {
+                SPDLOG_WARN("WebSocket error: {}", error.message());
+                remove_observer(failed);
+            });
+            socket->set_message_handler(message_handler);
+
+            observer->socket = socket;
+            std::lock_guard<std::mutex> lock(observers_mtx);
+            observers[socket->get_key()] = observer;
+        });
+    }
+} // namespace
+
+void websocket_api_create_endpoints(restbed::Service &service) {
+    auto resource_websocket = std::make_shared<restbed::Resource>();
+    resource_websocket->set_path("/ws");
+    resource_websocket->set_method_handler("GET", websocket_handler);
+    service.publish(resource_websocket);
+
+    event_stream.add_listener(broadcast_telemetry);
+}
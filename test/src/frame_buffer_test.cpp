@@ -0,0 +1,78 @@
+#include "frame_buffer.hpp"
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+
+namespace {
+    void receive(FrameBuffer &buffer, const std::string &bytes) {
+        char *dst = buffer.prepare(bytes.size());
+        ASSERT_NE(dst, nullptr);
+        ASSERT_GE(buffer.writable(), bytes.size());
+        std::memcpy(dst, bytes.data(), bytes.size());
+        buffer.commit(bytes.size());
+    }
+} // namespace
+
+TEST(FrameBufferTest, SplitsFramesOnTheDelimiter) {
+    FrameBuffer buffer(16);
+    receive(buffer, std::string("one\0two\0thr", 11));
+
+    EXPECT_EQ(buffer.next_frame(), "one");
+    EXPECT_EQ(buffer.next_frame(), "two");
+    EXPECT_FALSE(buffer.next_frame());
+    EXPECT_EQ(buffer.size(), 3u);
+
+    receive(buffer, std::string("ee\0", 3));
+    EXPECT_EQ(buffer.next_frame(), "three");
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST(FrameBufferTest, CompactsToKeepAFrameContiguous) {
+    FrameBuffer buffer(8, 8);
+    receive(buffer, std::string("ab\0cde", 6));
+    EXPECT_EQ(buffer.next_frame(), "ab");
+
+    // Only 2 bytes left at the tail, the 3 consumed ones at the front are reclaimed
+    receive(buffer, std::string("fg\0", 3));
+    EXPECT_EQ(buffer.next_frame(), "cdefg");
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST(FrameBufferTest, GrowsUpToMaxSize) {
+    FrameBuffer buffer(4, 16);
+    receive(buffer, "0123456789");
+    receive(buffer, "abcdef");
+    EXPECT_EQ(buffer.size(), 16u);
+    EXPECT_FALSE(buffer.next_frame());
+
+    // Full of a frame without its delimiter
+    EXPECT_EQ(buffer.prepare(1), nullptr);
+
+    buffer.clear();
+    EXPECT_NE(buffer.prepare(16), nullptr);
+    EXPECT_EQ(buffer.writable(), 16u);
+}
+
+TEST(FrameBufferTest, PrepareGivesWhatIsLeftBelowMaxSize) {
+    FrameBuffer buffer(4, 10);
+    receive(buffer, "0123456");
+    ASSERT_NE(buffer.prepare(8), nullptr);
+    EXPECT_EQ(buffer.writable(), 3u);
+}
+
+TEST(FrameBufferTest, UnframedConsume) {
+    FrameBuffer buffer;
+    receive(buffer, "abcdef");
+    EXPECT_EQ(buffer.data(), "abcdef");
+    buffer.consume(4);
+    EXPECT_EQ(buffer.data(), "ef");
+    buffer.consume(2);
+    EXPECT_TRUE(buffer.empty());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
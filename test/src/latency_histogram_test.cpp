@@ -0,0 +1,73 @@
+#include "metrics.hpp"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace std::chrono_literals;
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+    LatencyHistogram histogram;
+    for (int us = 0; us < 8; ++us) {
+        histogram.record(std::chrono::microseconds(us));
+    }
+    for (uint64_t us = 0; us <= 8; ++us) {
+        EXPECT_EQ(histogram.count_below(us), us);
+    }
+}
+
+TEST(LatencyHistogramTest, CountBelowPowersOfTwoIsExact) {
+    LatencyHistogram histogram;
+    for (int us = 1; us <= 500; ++us) {
+        histogram.record(std::chrono::microseconds(us));
+    }
+    EXPECT_EQ(histogram.count(), 500u);
+    EXPECT_EQ(histogram.count_below(256), 255u);
+    EXPECT_EQ(histogram.count_below(512), 500u);
+
+    histogram.record(512us);
+    histogram.record(1023us);
+    EXPECT_EQ(histogram.count_below(512), 500u);
+    EXPECT_EQ(histogram.count_below(1024), 502u);
+}
+
+TEST(LatencyHistogramTest, SumAndMax) {
+    LatencyHistogram histogram;
+    histogram.record(1500us);
+    histogram.record(2ms);
+    histogram.record(-5us); // Clamped to 0
+    EXPECT_EQ(histogram.count(), 3u);
+    EXPECT_DOUBLE_EQ(histogram.sum_seconds(), 0.0035);
+    EXPECT_DOUBLE_EQ(histogram.max_seconds(), 0.002);
+}
+
+TEST(LatencyHistogramTest, HugeValuesLandInTheLastBucket) {
+    LatencyHistogram histogram;
+    histogram.record(std::chrono::hours(24 * 365));
+    EXPECT_EQ(histogram.count(), 1u);
+    EXPECT_EQ(histogram.count_below(uint64_t{ 1 } << 40), 0u);
+}
+
+TEST(LatencyHistogramTest, PrometheusBucketsAreCumulativeAndExact) {
+    Metrics registry;
+    auto &histogram = registry.command_rtt["MOVE"];
+    for (int us = 1; us <= 500; ++us) {
+        histogram.record(std::chrono::microseconds(us));
+    }
+    histogram.record(3s);
+
+    std::string out = registry.prometheus();
+    EXPECT_NE(out.find("# TYPE rema_command_rtt_seconds histogram"), std::string::npos);
+    EXPECT_NE(out.find("rema_command_rtt_seconds_bucket{cmd=\"MOVE\",le=\"0.000256\"} 255\n"), std::string::npos);
+    EXPECT_NE(out.find("rema_command_rtt_seconds_bucket{cmd=\"MOVE\",le=\"0.000512\"} 500\n"), std::string::npos);
+    EXPECT_NE(out.find("rema_command_rtt_seconds_bucket{cmd=\"MOVE\",le=\"4.194304\"} 501\n"), std::string::npos);
+    EXPECT_NE(out.find("rema_command_rtt_seconds_bucket{cmd=\"MOVE\",le=\"+Inf\"} 501\n"), std::string::npos);
+    EXPECT_NE(out.find("rema_command_rtt_seconds_count{cmd=\"MOVE\"} 501\n"), std::string::npos);
+    EXPECT_EQ(out.find("_quantile"), std::string::npos);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
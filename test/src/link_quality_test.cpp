@@ -0,0 +1,99 @@
+#include "link_quality.hpp"
+
+#include <chrono>
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::time_point{} + 1h;
+} // namespace
+
+TEST(LinkQualityTest, SteadyStream) {
+    LinkQuality link;
+    link.connected(true);
+    for (int i = 0; i <= 10; ++i) {
+        link.frames_received(t0 + i * 100ms);
+    }
+
+    auto snapshot = link.snapshot(t0 + 1s);
+    EXPECT_EQ(snapshot.connection, 1u);
+    EXPECT_TRUE(snapshot.kernel_timestamps);
+    EXPECT_EQ(snapshot.frames, 11u);
+    EXPECT_EQ(snapshot.arrivals, 11u);
+    EXPECT_NEAR(snapshot.fps, 10., 1e-9);
+    EXPECT_NEAR(snapshot.interarrival_ms, 100., 1e-6);
+    EXPECT_NEAR(snapshot.jitter_ms, 0., 1e-6);
+    EXPECT_EQ(snapshot.gaps, 0u);
+}
+
+TEST(LinkQualityTest, BatchedFramesAreOneArrival) {
+    LinkQuality link;
+    link.connected(false);
+    for (int i = 0; i < 10; ++i) {
+        link.frames_received(t0 + i * 100ms);
+    }
+    // Three frames held up and read together, then the same read handed over in two parts
+    link.frames_received(t0 + 1200ms, 2);
+    link.frames_received(t0 + 1200ms, 1);
+
+    auto snapshot = link.snapshot(t0 + 1200ms);
+    EXPECT_EQ(snapshot.frames, 13u);
+    EXPECT_EQ(snapshot.arrivals, 11u);
+    EXPECT_NEAR(snapshot.fps, 12. / 1.2, 1e-9);
+    EXPECT_NEAR(snapshot.interarrival_ms, 120., 1e-6);
+    EXPECT_GT(snapshot.jitter_ms, 50.); // A zero interarrival per batched frame would have pulled it down
+    EXPECT_EQ(snapshot.gaps, 0u);
+}
+
+TEST(LinkQualityTest, Gaps) {
+    LinkQuality link;
+    link.connected(true);
+    for (int i = 0; i < 10; ++i) {
+        link.frames_received(t0 + i * 100ms);
+    }
+    link.frames_received(t0 + 1500ms); // 6 times the usual interarrival
+    link.frames_received(t0 + 1600ms);
+
+    auto snapshot = link.snapshot(t0 + 1600ms);
+    EXPECT_EQ(snapshot.gaps, 1u);
+    EXPECT_EQ(snapshot.gaps_total, 1u);
+
+    // Out of the window, but still counted for the connection
+    snapshot = link.snapshot(t0 + 10s);
+    EXPECT_EQ(snapshot.frames, 0u);
+    EXPECT_EQ(snapshot.gaps, 0u);
+    EXPECT_EQ(snapshot.gaps_total, 1u);
+}
+
+TEST(LinkQualityTest, ConnectedStartsAfresh) {
+    LinkQuality link;
+    link.connected(true);
+    link.frames_received(t0);
+    link.frames_received(t0 + 100ms);
+    link.frame_published(t0 + 100ms, t0 + 103ms);
+
+    link.connected(false);
+    auto snapshot = link.snapshot(t0 + 200ms);
+    EXPECT_EQ(snapshot.connection, 2u);
+    EXPECT_FALSE(snapshot.kernel_timestamps);
+    EXPECT_EQ(snapshot.frames, 0u);
+    EXPECT_EQ(snapshot.publish_latency_ms, 0.);
+}
+
+TEST(LinkQualityTest, PublishLatency) {
+    LinkQuality link;
+    link.connected(true);
+    link.frame_published(t0, t0 + 2ms);
+    link.frame_published(t0 + 100ms, t0 + 106ms);
+
+    auto snapshot = link.snapshot(t0 + 200ms);
+    EXPECT_NEAR(snapshot.publish_latency_ms, 4., 1e-6);
+    EXPECT_NEAR(snapshot.publish_latency_max_ms, 6., 1e-6);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,113 @@
+#include "msgpack_decode.hpp"
+#include "telemetry.hpp"
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <limits>
+#include <vector>
+
+namespace {
+    struct Sample {
+        int i = 0;
+        double d = 0.;
+        float f = 0.f;
+        uint64_t u = 0;
+        bool b = false;
+    };
+    MSGPACK_DEFINE_TYPE_NON_INTRUSIVE(Sample, i, d, f, u, b)
+
+    template <typename T> bool decode(const std::vector<uint8_t> &bytes, T &obj) {
+        msgpack_decode::Reader reader(bytes.data(), bytes.size());
+        return msgpack_decode::read(reader, obj);
+    }
+} // namespace
+
+TEST(MsgpackDecodeTest, DecodesAsNlohmannDoes) {
+    nlohmann::json json = { { "coords", { { "x", 1.25 }, { "y", -2.5 }, { "z", 100 } } },
+                            { "targets", { { "x", 0 }, { "y", 0 }, { "z", -3 } } },
+                            { "on_condition", { { "x_y", true }, { "z", false } } },
+                            { "joystick_movement", { { "x_y", false }, { "z", true } } },
+                            { "probe", { { "x_y", false }, { "z", false } } },
+                            { "stalled", { { "x", false }, { "y", true }, { "z", false } } },
+                            { "limits",
+                              { { "left", true },
+                                { "right", false },
+                                { "up", false },
+                                { "down", true },
+                                { "in", false },
+                                { "out", false },
+                                { "probe", true } } },
+                            { "control_enabled", true },
+                            { "stall_control", false },
+                            { "brakes_mode", 2 },
+                            { "probe_protected", true } };
+    struct telemetry decoded {};
+    ASSERT_TRUE(decode(nlohmann::json::to_msgpack(json), decoded));
+    auto expected = json.get<struct telemetry>();
+
+    EXPECT_EQ(decoded.coords.x, expected.coords.x);
+    EXPECT_EQ(decoded.coords.y, expected.coords.y);
+    EXPECT_EQ(decoded.coords.z, expected.coords.z);
+    EXPECT_EQ(decoded.targets.z, expected.targets.z);
+    EXPECT_EQ(decoded.on_condition, expected.on_condition);
+    EXPECT_EQ(decoded.joystick_movement, expected.joystick_movement);
+    EXPECT_EQ(decoded.probe, expected.probe);
+    EXPECT_EQ(decoded.stalled, expected.stalled);
+    EXPECT_EQ(decoded.limits, expected.limits);
+    EXPECT_EQ(decoded.control_enabled, expected.control_enabled);
+    EXPECT_EQ(decoded.stall_control, expected.stall_control);
+    EXPECT_EQ(decoded.brakes_mode, expected.brakes_mode);
+    EXPECT_EQ(decoded.probe_protected, expected.probe_protected);
+}
+
+TEST(MsgpackDecodeTest, EveryNumberWidth) {
+    for (int64_t value : { int64_t{ 0 }, int64_t{ 127 }, int64_t{ -32 }, int64_t{ -33 }, int64_t{ 200 }, int64_t{ -200 },
+                           int64_t{ 40000 }, int64_t{ -40000 }, int64_t{ 3000000000 }, int64_t{ -3000000000 } }) {
+        Sample sample;
+        ASSERT_TRUE(decode(nlohmann::json::to_msgpack({ { "d", value } }), sample)) << value;
+        EXPECT_EQ(sample.d, static_cast<double>(value));
+    }
+
+    Sample sample;
+    uint64_t big = std::numeric_limits<uint64_t>::max();
+    ASSERT_TRUE(decode(nlohmann::json::to_msgpack({ { "u", big }, { "i", -7 }, { "d", 0.1 } }), sample));
+    EXPECT_EQ(sample.u, big);
+    EXPECT_EQ(sample.i, -7);
+    EXPECT_EQ(sample.d, 0.1);
+
+    // float 32, which nlohmann only writes when it is lossless
+    const std::vector<uint8_t> float32 = { 0x81, 0xa1, 'f', 0xca, 0x3f, 0xc0, 0x00, 0x00 };
+    ASSERT_TRUE(decode(float32, sample));
+    EXPECT_EQ(sample.f, 1.5f);
+}
+
+TEST(MsgpackDecodeTest, UnknownKeysAreSkippedMissingOnesUntouched) {
+    Sample sample;
+    sample.i = 42;
+    auto bytes = nlohmann::json::to_msgpack(
+        { { "extra", { { "nested", { 1, 2, "three" } } } }, { "b", true }, { "text", std::string(40, 't') }, { "d", 2.5 } });
+    ASSERT_TRUE(decode(bytes, sample));
+    EXPECT_EQ(sample.i, 42);
+    EXPECT_TRUE(sample.b);
+    EXPECT_EQ(sample.d, 2.5);
+}
+
+TEST(MsgpackDecodeTest, MalformedInputFails) {
+    auto bytes = nlohmann::json::to_msgpack({ { "i", 70000 }, { "d", 1.5 }, { "b", true } });
+    for (std::size_t len = 0; len < bytes.size(); ++len) {
+        Sample sample;
+        std::vector<uint8_t> truncated(bytes.begin(), bytes.begin() + len);
+        EXPECT_FALSE(decode(truncated, sample)) << len;
+    }
+
+    Sample sample;
+    EXPECT_FALSE(decode(nlohmann::json::to_msgpack({ 1, 2 }), sample));          // Not a map
+    EXPECT_FALSE(decode(nlohmann::json::to_msgpack({ { "i", "1" } }), sample));   // Wrong type
+    EXPECT_FALSE(decode(nlohmann::json::to_msgpack({ { "b", 1 } }), sample));     // Not a bool
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,67 @@
+#include "msgpack_frame.hpp"
+#include "nlohmann/json.hpp"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> msgpack(const nlohmann::json &json) {
+        return nlohmann::json::to_msgpack(json);
+    }
+} // namespace
+
+TEST(MsgpackFrameTest, SizeOfCompleteObjects) {
+    for (const auto &json : { nlohmann::json(1), nlohmann::json(-100), nlohmann::json(70000), nlohmann::json(1.5),
+                              nlohmann::json("short"), nlohmann::json(std::string(300, 'x')), nlohmann::json(nullptr),
+                              nlohmann::json::array({ 1, "two", { { "three", 3 } } }),
+                              nlohmann::json{ { "coords", { { "x", 1.25 }, { "y", -2.5 }, { "z", 0. } } },
+                                              { "flags", { true, false } } } }) {
+        auto bytes = msgpack(json);
+        EXPECT_EQ(msgpack_frame::object_size(bytes.data(), bytes.size()), bytes.size()) << json.dump();
+    }
+}
+
+TEST(MsgpackFrameTest, IncompleteUntilTheLastByte) {
+    auto bytes = msgpack({ { "axis", "x" }, { "pos", { 1., 2., 3. } }, { "label", std::string(40, 'l') } });
+    for (std::size_t len = 0; len < bytes.size(); ++len) {
+        EXPECT_EQ(msgpack_frame::object_size(bytes.data(), len), msgpack_frame::incomplete) << len;
+    }
+}
+
+TEST(MsgpackFrameTest, FirstOfConcatenatedObjects) {
+    auto first = msgpack({ { "a", 1 } });
+    auto stream = first;
+    auto second = msgpack({ 1, 2, 3 });
+    stream.insert(stream.end(), second.begin(), second.end());
+    EXPECT_EQ(msgpack_frame::object_size(stream.data(), stream.size()), first.size());
+}
+
+TEST(MsgpackFrameTest, NeverUsedByteIsInvalid) {
+    const uint8_t bytes[] = { 0xc1, 0x00 };
+    EXPECT_EQ(msgpack_frame::object_size(bytes, sizeof(bytes)), msgpack_frame::invalid);
+}
+
+TEST(MsgpackFrameTest, FindUintInTopLevelMap) {
+    auto bytes = msgpack({ { "cmd", "MOVE" }, { "pars", { { "x", 1 } } }, { "request_id", 4000000000u } });
+    EXPECT_EQ(msgpack_frame::find_uint(bytes.data(), bytes.size(), "request_id"), 4000000000u);
+
+    bytes = msgpack({ { "request_id", 7 } });
+    EXPECT_EQ(msgpack_frame::find_uint(bytes.data(), bytes.size(), "request_id"), 7u);
+}
+
+TEST(MsgpackFrameTest, FindUintMissingOrNotAMap) {
+    auto bytes = msgpack({ { "pars", { { "request_id", 3 } } } }); // Nested, not top level
+    EXPECT_EQ(msgpack_frame::find_uint(bytes.data(), bytes.size(), "request_id"), 0u);
+
+    bytes = msgpack({ { "request_id", "3" } }); // Not an unsigned integer
+    EXPECT_EQ(msgpack_frame::find_uint(bytes.data(), bytes.size(), "request_id"), 0u);
+
+    bytes = msgpack({ 1, 2, 3 });
+    EXPECT_EQ(msgpack_frame::find_uint(bytes.data(), bytes.size(), "request_id"), 0u);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
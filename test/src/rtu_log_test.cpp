@@ -0,0 +1,68 @@
+#include "rtu_log.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+TEST(RtuLogTest, LinesAreNumberedInArrivalOrder) {
+    RtuLog log;
+    log.add("zero");
+    log.add("one");
+    log.add("two");
+
+    auto all = log.since(0);
+    EXPECT_EQ(all.lines, (std::vector<std::string>{ "zero", "one", "two" }));
+    EXPECT_EQ(all.next, 3u);
+
+    auto middle = log.since(1, 2);
+    EXPECT_EQ(middle.lines, (std::vector<std::string>{ "one" }));
+    EXPECT_EQ(middle.next, 2u);
+
+    auto ahead = log.since(7);
+    EXPECT_TRUE(ahead.lines.empty());
+    EXPECT_EQ(ahead.next, 3u);
+}
+
+TEST(RtuLogTest, KeepsTheLastMaxKept) {
+    RtuLog log;
+    for (std::size_t i = 0; i < RtuLog::max_kept + 5; ++i) {
+        log.add(std::to_string(i));
+    }
+
+    auto kept = log.since(0);
+    ASSERT_EQ(kept.lines.size(), RtuLog::max_kept);
+    EXPECT_EQ(kept.lines.front(), "5");
+    EXPECT_EQ(kept.next, RtuLog::max_kept + 5);
+
+    EXPECT_EQ(log.since(RtuLog::max_kept + 4).lines, (std::vector<std::string>{ std::to_string(RtuLog::max_kept + 4) }));
+}
+
+TEST(RtuLogTest, WritesEveryLineToTheFile) {
+    auto path = std::filesystem::temp_directory_path() / "rtu_log_test.log";
+    std::filesystem::remove(path);
+    {
+        RtuLog log;
+        ASSERT_TRUE(log.open(path));
+        for (int i = 0; i < 1000; ++i) {
+            log.add("line " + std::to_string(i));
+        }
+    }
+
+    std::ifstream file(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(file, line);) {
+        lines.push_back(line);
+    }
+    ASSERT_EQ(lines.size(), 1000u);
+    EXPECT_EQ(lines.front(), "line 0");
+    EXPECT_EQ(lines.back(), "line 999");
+    std::filesystem::remove(path);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,108 @@
+#include "seqlock.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Every field holds the same number, a torn read would mix two of them
+    struct Wide {
+        std::array<uint64_t, 9> values{};
+        char tail[5]{};
+    };
+
+    // Not trivial, like struct telemetry: a default constructor of its own and default member initializers
+    struct Defaulted {
+        Defaulted() {
+        }
+
+        double x = 1;
+        int n = 2;
+    };
+
+    Wide wide(uint64_t n) {
+        Wide res;
+        res.values.fill(n);
+        std::fill(std::begin(res.tail), std::end(res.tail), static_cast<char>(n));
+        return res;
+    }
+} // namespace
+
+TEST(SeqlockTest, LoadsWhatWasStored) {
+    Seqlock<Wide> seqlock;
+    EXPECT_EQ(seqlock.load().values[0], 0u);
+
+    seqlock.store(wide(7));
+    Wide value = seqlock.load();
+    EXPECT_EQ(value.values[8], 7u);
+    EXPECT_EQ(value.tail[4], 7);
+
+    Seqlock<double> initialized(1.5);
+    EXPECT_EQ(initialized.load(), 1.5);
+}
+
+TEST(SeqlockTest, LoadsOverTheDefaults) {
+    Seqlock<Defaulted> seqlock;
+    EXPECT_EQ(seqlock.load().x, 1.);
+
+    Defaulted value;
+    value.x = -3.5;
+    value.n = 7;
+    seqlock.store(value);
+    EXPECT_EQ(seqlock.load().x, -3.5);
+    EXPECT_EQ(seqlock.load().n, 7);
+}
+
+TEST(SeqlockTest, VersionCountsStores) {
+    Seqlock<int> seqlock;
+    uint64_t version = seqlock.version();
+    seqlock.store(1);
+    seqlock.store(2);
+    EXPECT_EQ(seqlock.version(), version + 2);
+}
+
+TEST(SeqlockTest, ReadersNeverSeeATornValue) {
+    Seqlock<Wide> seqlock;
+    constexpr uint64_t stores = 200000;
+    std::atomic<bool> done = false;
+    std::atomic<uint64_t> torn = 0;
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&] {
+            uint64_t last = 0;
+            while (!done) {
+                Wide value = seqlock.load();
+                for (uint64_t v : value.values) {
+                    if (v != value.values[0]) {
+                        ++torn;
+                    }
+                }
+                if (value.tail[4] != static_cast<char>(value.values[0]) || value.values[0] < last) {
+                    ++torn;
+                }
+                last = value.values[0];
+            }
+        });
+    }
+
+    for (uint64_t n = 1; n <= stores; ++n) {
+        seqlock.store(wide(n));
+    }
+    done = true;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(torn, 0u);
+    EXPECT_EQ(seqlock.load().values[0], stores);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,55 @@
+#include "settle_detector.hpp"
+
+#include <gtest/gtest.h>
+
+namespace {
+    SettleDetector::Params params(std::size_t window, double tolerance) {
+        SettleDetector::Params res;
+        res.window = window;
+        res.tolerance = tolerance;
+        return res;
+    }
+} // namespace
+
+TEST(SettleDetectorTest, NotSettledUntilTheWindowIsFull) {
+    SettleDetector detector(params(3, 0.005));
+    EXPECT_FALSE(detector.add({ 1., 2., 3. }));
+    EXPECT_FALSE(detector.add({ 1., 2., 3. }));
+    EXPECT_TRUE(detector.add({ 1., 2., 3. }));
+}
+
+TEST(SettleDetectorTest, StillMovingOnAnyAxis) {
+    SettleDetector detector(params(3, 0.005));
+    detector.add({ 0., 0., 0. });
+    detector.add({ 0., 0., 0.1 });
+    EXPECT_FALSE(detector.add({ 0., 0., 0.2 }));
+
+    // The moving samples leave the window one at a time
+    EXPECT_FALSE(detector.add({ 0., 0., 0.2 }));
+    EXPECT_TRUE(detector.add({ 0., 0., 0.2 }));
+}
+
+TEST(SettleDetectorTest, JitterWithinTolerance) {
+    SettleDetector detector(params(4, 0.005));
+    detector.add({ 10., 5., 0. });
+    detector.add({ 10.004, 5., 0. });
+    detector.add({ 9.996, 5.004, 0. });
+    EXPECT_TRUE(detector.add({ 10., 4.996, 0. }));
+
+    // A standard deviation of 0.01 is twice the tolerance
+    SettleDetector strict(params(2, 0.005));
+    strict.add({ 0., 0., 0. });
+    EXPECT_FALSE(strict.add({ 0.02, 0., 0. }));
+}
+
+TEST(SettleDetectorTest, WindowOfAtLeastTwo) {
+    SettleDetector detector(params(0, 0.005));
+    EXPECT_FALSE(detector.add({ 1., 1., 1. }));
+    EXPECT_TRUE(detector.add({ 1., 1., 1. }));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,70 @@
+#include "spsc_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <thread>
+
+TEST(SpscQueueTest, FifoUpToCapacity) {
+    SpscQueue<int, 4> queue;
+    int value;
+    EXPECT_FALSE(queue.try_pop(value));
+
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(queue.try_push(i));
+    }
+    EXPECT_FALSE(queue.try_push(4)); // Full
+
+    EXPECT_TRUE(queue.try_pop(value));
+    EXPECT_EQ(value, 0);
+    EXPECT_TRUE(queue.try_push(4)); // Room again, the slot wraps around
+    for (int i = 1; i <= 4; ++i) {
+        EXPECT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(queue.try_pop(value));
+}
+
+TEST(SpscQueueTest, CloseWakesAWaitingConsumer) {
+    SpscQueue<int, 4> queue;
+    std::atomic<bool> returned = false;
+    std::thread consumer([&] {
+        int value;
+        EXPECT_FALSE(queue.pop(value));
+        returned = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(returned);
+    queue.close();
+    consumer.join();
+    EXPECT_TRUE(returned);
+}
+
+TEST(SpscQueueTest, EveryElementOnceAndInOrder) {
+    SpscQueue<uint64_t, 64> queue;
+    constexpr uint64_t count = 200000; // Also the end marker, pop() gives up at once on a closed queue
+
+    std::thread consumer([&] {
+        uint64_t expected = 0;
+        uint64_t value;
+        while (queue.pop(value) && value != count) {
+            EXPECT_EQ(value, expected);
+            expected = value + 1;
+        }
+        EXPECT_EQ(expected, count);
+    });
+
+    for (uint64_t i = 0; i <= count; ++i) {
+        while (!queue.try_push(i)) {
+            std::this_thread::yield();
+        }
+    }
+    consumer.join();
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
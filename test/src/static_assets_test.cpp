@@ -0,0 +1,49 @@
+#include "static_assets.hpp"
+
+#include <gtest/gtest.h>
+
+using http_headers::accepts;
+using http_headers::none_match;
+
+TEST(StaticAssetsTest, AcceptsListedCodings) {
+    EXPECT_TRUE(accepts("gzip, deflate, br", "br"));
+    EXPECT_TRUE(accepts("gzip, deflate, br", "gzip"));
+    EXPECT_TRUE(accepts("GZip", "gzip"));
+    EXPECT_TRUE(accepts("gzip;q=0.5, br;q=1.0", "gzip"));
+    EXPECT_FALSE(accepts("gzip, deflate", "br"));
+    EXPECT_FALSE(accepts("", "gzip"));
+    EXPECT_FALSE(accepts("identity", "gzip"));
+}
+
+TEST(StaticAssetsTest, QZeroRefuses) {
+    EXPECT_FALSE(accepts("gzip, br;q=0", "br"));
+    EXPECT_FALSE(accepts("br; q=0.000", "br"));
+    EXPECT_FALSE(accepts("br;q=junk", "br"));
+}
+
+TEST(StaticAssetsTest, NamedCodingOverridesWildcard) {
+    EXPECT_TRUE(accepts("*;q=0, br", "br"));
+    EXPECT_FALSE(accepts("*;q=0, br", "gzip"));
+    EXPECT_FALSE(accepts("*, br;q=0", "br"));
+    EXPECT_TRUE(accepts("*, br;q=0", "gzip"));
+    EXPECT_TRUE(accepts("*", "gzip"));
+}
+
+TEST(StaticAssetsTest, NoneMatch) {
+    const std::string hash = "0123456789abcdef0123456789abcdef";
+    EXPECT_TRUE(none_match("\"" + hash + "\"", hash));
+    EXPECT_TRUE(none_match("W/\"" + hash + "-gz\"", hash));
+    EXPECT_TRUE(none_match("\"other\", \"" + hash + "-br\"", hash));
+    EXPECT_TRUE(none_match("*", hash));
+
+    EXPECT_FALSE(none_match("", hash));
+    EXPECT_FALSE(none_match(hash, hash)); // Not quoted
+    EXPECT_FALSE(none_match("\"" + hash + "0\"", hash));
+    EXPECT_FALSE(none_match("\"" + hash.substr(1) + "\"", hash));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
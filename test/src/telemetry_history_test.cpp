@@ -0,0 +1,118 @@
+#include "telemetry_history.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+    const TelemetryHistory::clock::time_point t0{};
+
+    struct telemetry at(double x) {
+        struct telemetry res {};
+        res.coords.x = x;
+        return res;
+    }
+} // namespace
+
+TEST(TelemetryHistoryTest, RangeIsInclusiveAndOrdered) {
+    TelemetryHistory history(16);
+    for (int i = 0; i < 10; ++i) {
+        history.push(t0 + i * 100ms, at(i));
+    }
+
+    auto entries = history.range(t0 + 250ms, t0 + 500ms);
+    ASSERT_EQ(entries.size(), 3u);
+    EXPECT_EQ(entries[0].telemetry.coords.x, 3.);
+    EXPECT_EQ(entries[2].telemetry.coords.x, 5.);
+    EXPECT_EQ(entries[2].time, t0 + 500ms);
+
+    EXPECT_EQ(history.range(t0 + 300ms, t0 + 300ms).size(), 1u);
+    EXPECT_TRUE(history.range(t0 + 2s, t0 + 3s).empty());
+    EXPECT_EQ(history.range(t0 - 1s, t0 + 1s).size(), 10u);
+}
+
+TEST(TelemetryHistoryTest, KeepsTheWholeFrame) {
+    struct telemetry frame = at(1.5);
+    frame.targets = Point3D(4, 5, 6);
+    frame.probe.z = true;
+    frame.stalled.y = true;
+    frame.limits.probe = true;
+    frame.brakes_mode = 2;
+
+    TelemetryHistory history(2);
+    history.push(t0, frame);
+    auto entries = history.range(t0, t0);
+    ASSERT_EQ(entries.size(), 1u);
+    const struct telemetry &stored = entries[0].telemetry;
+    EXPECT_EQ(stored.coords.x, 1.5);
+    EXPECT_EQ(stored.targets.z, 6.);
+    EXPECT_TRUE(stored.probe.z);
+    EXPECT_FALSE(stored.probe.x_y);
+    EXPECT_TRUE(stored.stalled.y);
+    EXPECT_TRUE(stored.limits.probe);
+    EXPECT_EQ(stored.brakes_mode, 2);
+}
+
+TEST(TelemetryHistoryTest, KeepsOnlyTheLastCapacityEntries) {
+    TelemetryHistory history(4);
+    for (int i = 0; i < 10; ++i) {
+        history.push(t0 + i * 1ms, at(i));
+    }
+
+    auto entries = history.range(t0, t0 + 1s);
+    ASSERT_EQ(entries.size(), 4u);
+    EXPECT_EQ(entries.front().telemetry.coords.x, 6.);
+    EXPECT_EQ(entries.back().telemetry.coords.x, 9.);
+}
+
+TEST(TelemetryHistoryTest, Latest) {
+    TelemetryHistory history(4);
+    EXPECT_TRUE(history.latest(3).empty());
+
+    history.push(t0, at(0));
+    history.push(t0 + 1ms, at(1));
+    auto entries = history.latest(3);
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_EQ(entries.back().telemetry.coords.x, 1.);
+
+    for (int i = 2; i < 10; ++i) {
+        history.push(t0 + i * 1ms, at(i));
+    }
+    entries = history.latest(10);
+    ASSERT_EQ(entries.size(), 4u);
+    EXPECT_EQ(entries.front().telemetry.coords.x, 6.);
+}
+
+TEST(TelemetryHistoryTest, ReadersWhileTheWriterWraps) {
+    TelemetryHistory history(64);
+    std::atomic<bool> done = false;
+    std::atomic<int> unordered = 0;
+
+    std::thread reader([&] {
+        while (!done) {
+            auto entries = history.range(t0, t0 + 1h);
+            for (std::size_t i = 1; i < entries.size(); ++i) {
+                if (entries[i].time < entries[i - 1].time ||
+                    entries[i].telemetry.coords.x != (entries[i].time - t0) / 1us) {
+                    ++unordered;
+                }
+            }
+        }
+    });
+
+    for (int i = 0; i < 100000; ++i) {
+        history.push(t0 + i * 1us, at(i));
+    }
+    done = true;
+    reader.join();
+    EXPECT_EQ(unordered, 0);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,9 +1,10 @@
 
 class WebSocketClient {
+    // handlers may also set port and path, e.g. { port: window.location.port, path: "/ws?telemetry=1" } for the proxy
     constructor(host, handlers = {}) {
-        this.path = "";
+        this.path = handlers.path || "";
         this.host = host;
-        this.port = 8765;
+        this.port = handlers.port || 8765;
         this.maxReconnectAttempts = 1000;
         this.reconnectAttempts = 0;
         this.socket = null;